@@ -0,0 +1,355 @@
+#pragma once
+
+#include "Benchmarks.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//Scratch file and read sizes for the I/O benchmark
+static const size_t IO_BENCHMARK_FILE_SIZE = 256 * 1024 * 1024;
+static const size_t IO_BENCHMARK_BUFFER_SIZE = 256 * 1024;
+static const size_t IO_BENCHMARK_CHAIN_LENGTH = 4;//Buffers per scatter read, so each read is 1MB like the malloc version
+static const int IO_BENCHMARK_PASSES = 4;
+
+static double SecondsSince(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+//Touches one byte per page, the way a loader would at least look at what it read
+static unsigned int ConsumeBuffer(const unsigned char* pData, size_t length)
+{
+	unsigned int sum = 0;
+	for (size_t i = 0; i < length; i += 4096)
+		sum += pData[i];
+	return sum;
+}
+
+#ifdef _WIN32
+typedef HANDLE BenchmarkFile;
+static const BenchmarkFile INVALID_BENCHMARK_FILE = INVALID_HANDLE_VALUE;
+
+//Both benchmark passes open the file unbuffered, so neither is served from the page cache
+static BenchmarkFile OpenBenchmarkFile(const char* filePath)
+{
+	DWORD flags = FILE_FLAG_SEQUENTIAL_SCAN | FILE_FLAG_NO_BUFFERING;
+	return CreateFileA(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+}
+
+//There is no readv, so issue one ReadFile per entry
+static size_t ReadBenchmarkFile(BenchmarkFile file, IoVec* pIoVec, size_t count)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		DWORD bytesRead = 0;
+		if (!ReadFile(file, pIoVec[i].iov_base, (DWORD)pIoVec[i].iov_len, &bytesRead, NULL) || bytesRead == 0)
+			break;
+		total += bytesRead;
+	}
+	return total;
+}
+
+static void CloseBenchmarkFile(BenchmarkFile file)
+{
+	CloseHandle(file);
+}
+
+static void* AllocateReadBuffer(size_t size)
+{
+	return _aligned_malloc(size, IoBufferPool::GetPageSize());
+}
+
+static void FreeReadBuffer(void* pBuffer)
+{
+	_aligned_free(pBuffer);
+}
+#else
+typedef int BenchmarkFile;
+static const BenchmarkFile INVALID_BENCHMARK_FILE = -1;
+
+static BenchmarkFile OpenBenchmarkFile(const char* filePath)
+{
+	int flags = O_RDONLY;
+#ifdef O_DIRECT
+	//tmpfs and some other file systems refuse O_DIRECT, fall back to a buffered read there (for both passes alike)
+	int fd = open(filePath, flags | O_DIRECT);
+	if (fd >= 0)
+		return fd;
+#endif
+	return open(filePath, flags);
+}
+
+static size_t ReadBenchmarkFile(BenchmarkFile file, IoVec* pIoVec, size_t count)
+{
+	ssize_t bytesRead = readv(file, pIoVec, (int)count);
+	return (bytesRead > 0) ? (size_t)bytesRead : 0;
+}
+
+static void CloseBenchmarkFile(BenchmarkFile file)
+{
+	close(file);
+}
+
+static void* AllocateReadBuffer(size_t size)
+{
+	void* pBuffer = nullptr;
+	return (posix_memalign(&pBuffer, IoBufferPool::GetPageSize(), size) == 0) ? pBuffer : nullptr;
+}
+
+static void FreeReadBuffer(void* pBuffer)
+{
+	free(pBuffer);
+}
+#endif
+
+static bool WriteBenchmarkFile(const char* filePath)
+{
+	FILE* pFile = fopen(filePath, "wb");
+	if (!pFile)
+		return false;
+
+	unsigned char* pChunk = (unsigned char*)malloc(IO_BENCHMARK_BUFFER_SIZE);
+	bool ok = (pChunk != nullptr);
+	for (size_t written = 0; ok && written < IO_BENCHMARK_FILE_SIZE; written += IO_BENCHMARK_BUFFER_SIZE)
+	{
+		for (size_t i = 0; i < IO_BENCHMARK_BUFFER_SIZE; i++)
+			pChunk[i] = (unsigned char)(written + i);
+		ok = (fwrite(pChunk, 1, IO_BENCHMARK_BUFFER_SIZE, pFile) == IO_BENCHMARK_BUFFER_SIZE);
+	}
+	free(pChunk);
+	fclose(pFile);
+	return ok;
+}
+
+void BenchmarkIoBufferPool(const char* filePath)
+{
+	try
+	{
+		if (!WriteBenchmarkFile(filePath))
+		{
+			cout << "Could not write " << filePath << endl;
+			return;
+		}
+
+		const size_t readSize = IO_BENCHMARK_BUFFER_SIZE * IO_BENCHMARK_CHAIN_LENGTH;
+		const double totalMB = (double)IO_BENCHMARK_FILE_SIZE * IO_BENCHMARK_PASSES / (1024 * 1024);
+		unsigned int checksum = 0;
+
+		//malloc + read: a fresh heap buffer for every read, freed once it has been consumed. The read is unbuffered like
+		//the pool's, so the buffer has to be page aligned here too.
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for (int pass = 0; pass < IO_BENCHMARK_PASSES; pass++)
+		{
+			BenchmarkFile file = OpenBenchmarkFile(filePath);
+			if (file == INVALID_BENCHMARK_FILE)
+				break;
+			for (;;)
+			{
+				IoVec ioVec;
+				ioVec.iov_base = AllocateReadBuffer(readSize);
+				if (!ioVec.iov_base)
+					break;
+				ioVec.iov_len = readSize;
+				size_t bytesRead = ReadBenchmarkFile(file, &ioVec, 1);
+				checksum += ConsumeBuffer((unsigned char*)ioVec.iov_base, bytesRead);
+				FreeReadBuffer(ioVec.iov_base);
+				if (bytesRead < readSize)
+					break;
+			}
+			CloseBenchmarkFile(file);
+		}
+		double mallocSeconds = SecondsSince(start);
+
+		//IoBufferPool: a chain of pooled page aligned buffers filled by one unbuffered scatter read, same open as above
+		IoBufferPool pool;
+		if (!pool.Init(IO_BENCHMARK_BUFFER_SIZE, 16))
+		{
+			cout << "Could not initialize the IoBufferPool" << endl;
+			remove(filePath);
+			return;
+		}
+		start = chrono::steady_clock::now();
+		for (int pass = 0; pass < IO_BENCHMARK_PASSES; pass++)
+		{
+			BenchmarkFile file = OpenBenchmarkFile(filePath);
+			if (file == INVALID_BENCHMARK_FILE)
+				break;
+			for (;;)
+			{
+				IoBuffer chain[IO_BENCHMARK_CHAIN_LENGTH];
+				for (size_t i = 0; i < IO_BENCHMARK_CHAIN_LENGTH; i++)
+					chain[i] = pool.Acquire();
+
+				IoVec ioVec[IO_BENCHMARK_CHAIN_LENGTH];
+				size_t entries = IoBufferPool::FillIoVec(chain, IO_BENCHMARK_CHAIN_LENGTH, ioVec);
+				size_t bytesRead = ReadBenchmarkFile(file, ioVec, entries);
+				for (size_t i = 0; i < entries && i * IO_BENCHMARK_BUFFER_SIZE < bytesRead; i++)
+					checksum -= ConsumeBuffer(chain[i].GetData(), IO_BENCHMARK_BUFFER_SIZE);
+				if (bytesRead < readSize)
+					break;
+			}//The chain goes out of scope here and the buffers go back to the pool
+			CloseBenchmarkFile(file);
+		}
+		double poolSeconds = SecondsSince(start);
+
+		cout << "aligned malloc + read: " << totalMB / mallocSeconds << " MB/s" << endl;
+		cout << "IoBufferPool + readv:  " << totalMB / poolSeconds << " MB/s" << endl;
+		cout << "checksum (should be 0): " << checksum << endl;
+		remove(filePath);
+	}
+	catch (exception& ex)
+	{
+		cout << ex.what() << endl;
+	}
+}
+
+//Threads and operations for the reclamation benchmark
+static const unsigned int RECLAIM_BENCHMARK_THREADS = 4;
+static const unsigned int RECLAIM_BENCHMARK_OPERATIONS = 200000;//Push + pop pairs per thread
+
+struct EpochStackNode
+{
+	unsigned int m_value;
+	EpochStackNode* m_pNext;
+};
+
+//Treiber stack with pooled nodes. A popped node is retired instead of freed, so a thread that is still looking at it
+//(and its m_pNext) never reads a recycled chunk. That also takes care of ABA on the head.
+class EpochStack
+{
+	atomic<EpochStackNode*> m_pHead;
+	MemoryPool& m_nodePool;
+	EpochReclaimer& m_reclaimer;
+
+public:
+	EpochStack(MemoryPool& nodePool, EpochReclaimer& reclaimer) : m_nodePool(nodePool), m_reclaimer(reclaimer)
+	{
+		m_pHead.store(nullptr);
+		return;
+	}
+
+	bool Push(unsigned int value)
+	{
+		EpochStackNode* pNode = (EpochStackNode*)m_reclaimer.Alloc(m_nodePool);
+		if (!pNode)
+			return false;
+		pNode->m_value = value;
+		pNode->m_pNext = m_pHead.load(memory_order_relaxed);
+		while (!m_pHead.compare_exchange_weak(pNode->m_pNext, pNode, memory_order_release, memory_order_relaxed));
+		return true;
+	}
+
+	bool Pop(unsigned int& value)
+	{
+		if (!m_reclaimer.EnterCritical())
+			return false;
+		EpochStackNode* pTop = m_pHead.load(memory_order_acquire);
+		while (pTop && !m_pHead.compare_exchange_weak(pTop, pTop->m_pNext, memory_order_acquire, memory_order_acquire));
+		if (pTop)
+		{
+			value = pTop->m_value;
+			m_reclaimer.Retire(pTop, m_nodePool);
+		}
+		m_reclaimer.ExitCritical();
+		return pTop != nullptr;
+	}
+};
+
+struct SharedStackNode
+{
+	unsigned int m_value;
+	shared_ptr<SharedStackNode> m_pNext;
+};
+
+//The same stack where the reference counts decide when a node can be deleted
+class SharedStack
+{
+	shared_ptr<SharedStackNode> m_pHead;
+
+public:
+	bool Push(unsigned int value)
+	{
+		shared_ptr<SharedStackNode> pNode = make_shared<SharedStackNode>();
+		pNode->m_value = value;
+		pNode->m_pNext = atomic_load(&m_pHead);
+		while (!atomic_compare_exchange_weak(&m_pHead, &pNode->m_pNext, pNode));
+		return true;
+	}
+
+	bool Pop(unsigned int& value)
+	{
+		shared_ptr<SharedStackNode> pTop = atomic_load(&m_pHead);
+		while (pTop && !atomic_compare_exchange_weak(&m_pHead, &pTop, pTop->m_pNext));
+		if (pTop)
+			value = pTop->m_value;
+		return pTop != nullptr;
+	}
+};
+
+template<class Stack>
+static double RunStackBenchmark(Stack& stack, unsigned long long& popSum)
+{
+	atomic<unsigned long long> sum(0);
+	vector<thread> threads;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (unsigned int t = 0; t < RECLAIM_BENCHMARK_THREADS; t++)
+	{
+		threads.push_back(thread([&stack, &sum]()
+		{
+			unsigned long long localSum = 0;
+			unsigned int value = 0;
+			for (unsigned int i = 0; i < RECLAIM_BENCHMARK_OPERATIONS; i++)
+			{
+				if (stack.Push(i) && stack.Pop(value))
+					localSum += value;
+			}
+			sum += localSum;
+		}));
+	}
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	popSum = sum.load();
+	return SecondsSince(start);
+}
+
+void BenchmarkEpochReclaimer(void)
+{
+	try
+	{
+		//The pool is declared first so the reclaimer (which frees into it) is destroyed first
+		MemoryPool nodePool;
+		if (!nodePool.Init(sizeof(EpochStackNode), 4096))
+		{
+			cout << "Could not initialize the node pool" << endl;
+			return;
+		}
+		EpochReclaimer reclaimer;
+
+		EpochStack epochStack(nodePool, reclaimer);
+		unsigned long long epochSum = 0;
+		double epochSeconds = RunStackBenchmark(epochStack, epochSum);
+
+		SharedStack sharedStack;
+		unsigned long long sharedSum = 0;
+		double sharedSeconds = RunStackBenchmark(sharedStack, sharedSum);
+
+		double operations = 2.0 * RECLAIM_BENCHMARK_THREADS * RECLAIM_BENCHMARK_OPERATIONS;
+		cout << "EpochReclaimer stack:  " << epochSeconds << " s (" << epochSeconds * 1e9 / operations << " ns/op)" << endl;
+		cout << "shared_ptr stack:      " << sharedSeconds << " s (" << sharedSeconds * 1e9 / operations << " ns/op)" << endl;
+		cout << "pop sums (should match): " << epochSum << " " << sharedSum << endl;
+	}
+	catch (exception& ex)
+	{
+		cout << ex.what() << endl;
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <iostream>
+#include <exception>
+#include "IoBufferPool.h"
+#include "EpochReclaimer.h"
+
+using namespace std;
+
+//Streams a scratch file at filePath (created, then deleted) with a page aligned malloc per read and with IoBufferPool
+//buffers + a scatter read, and prints the throughput of both. Both sides open the file unbuffered (O_DIRECT /
+//FILE_FLAG_NO_BUFFERING where the file system allows it), so only the buffer management differs.
+void BenchmarkIoBufferPool(const char* filePath);
+
+//Runs the same push/pop mix on two lock free (Treiber) stacks from several threads, one with pooled nodes reclaimed
+//through an EpochReclaimer and one with shared_ptr nodes, and prints the time of both.
+void BenchmarkEpochReclaimer(void);
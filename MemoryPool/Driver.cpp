@@ -5,6 +5,8 @@
 #include<iostream>
 #include "MemoryPool.h"
 #include <exception>
+#include <cstring>
+#include "Benchmarks.h"
 //#include "SharedPointers.h"
 
 using namespace std;
@@ -12,10 +14,18 @@ using namespace std;
 
  
 
-int main(void)
+int main(int argc, char** argv)
 {
 	try
 	{
+		//MemoryPool.exe benchmark  runs the benchmarks instead of the demo
+		if (argc > 1 && strcmp(argv[1], "benchmark") == 0)
+		{
+			BenchmarkIoBufferPool("IoBufferPoolBenchmark.bin");
+			BenchmarkEpochReclaimer();
+			return 0;
+		}
+
 		void* ptr = nullptr;
 		void* ptr2 = nullptr;
 		 
@@ -0,0 +1,330 @@
+#pragma once
+
+#include "EpochReclaimer.h"
+
+	EpochReclaimer::EpochReclaimer(void)
+	{
+		m_globalEpoch.store(0);
+		for (unsigned int i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			m_slots[i].m_isClaimed.store(false);
+			m_slots[i].m_ownerThread.store(thread::id());
+			m_slots[i].m_localEpoch.store(0);
+			m_slots[i].m_nestDepth = 0;
+			m_slots[i].m_isReclaimPending = false;
+			for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+				m_slots[i].m_retiredEpoch[e] = 0;
+		}
+		for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+			m_orphanedEpoch[e] = 0;
+
+		ReclaimerRegistry& registry = GetRegistry();
+		lock_guard<mutex> lock(registry.m_lock);
+		m_instanceId = registry.m_nextInstanceId++;
+		registry.m_live[this] = m_instanceId;
+		return;
+	}
+
+	EpochReclaimer::~EpochReclaimer(void)
+	{
+		//From here on exiting threads leave their slots alone
+		{
+			ReclaimerRegistry& registry = GetRegistry();
+			lock_guard<mutex> lock(registry.m_lock);
+			registry.m_live.erase(this);
+		}
+
+		//Nobody is reading anymore, everything still retired goes back to its pool
+		for (unsigned int i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+				FreeRetiredList(m_slots[i].m_retired[e]);
+		}
+		for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+			FreeRetiredList(m_orphaned[e]);
+		return;
+	}
+
+	bool EpochReclaimer::EnterCritical(void)
+	{
+		ParticipantSlot* pSlot = GetSlot();
+		if (!pSlot)
+			return false;//Every slot belongs to a live thread, nothing would hold the epoch back for us
+		if (pSlot->m_nestDepth++ > 0)
+			return true;
+
+		//Lists from two epochs back can't be reached by anyone anymore. Free them while we are still outside,
+		//waiting on the pool lock inside a critical section would hold the epoch back for everybody.
+		ReclaimSafeLists(*pSlot, m_globalEpoch.load(memory_order_acquire));
+
+		//Publish the epoch we are reading in. This has to be visible before any shared node is loaded. The caller's loads
+		//are only acquire, and those may move ahead of a store, so the fence is needed for the store to load ordering.
+		unsigned long long globalEpoch = m_globalEpoch.load(memory_order_seq_cst);
+		pSlot->m_localEpoch.store((globalEpoch << 1) | 1, memory_order_seq_cst);
+		atomic_thread_fence(memory_order_seq_cst);
+		return true;
+	}
+
+	void EpochReclaimer::ExitCritical(void)
+	{
+		ParticipantSlot* pSlot = GetSlot();
+		if (!pSlot || pSlot->m_nestDepth == 0 || --pSlot->m_nestDepth > 0)
+			return;
+
+		pSlot->m_localEpoch.store(pSlot->m_localEpoch.load(memory_order_relaxed) & ~1ull, memory_order_release);
+
+		//Retire asked for a reclaim, do it now that we no longer hold the epoch back
+		if (pSlot->m_isReclaimPending)
+		{
+			pSlot->m_isReclaimPending = false;
+			TryAdvanceEpoch();
+			unsigned long long globalEpoch = m_globalEpoch.load(memory_order_acquire);
+			ReclaimSafeLists(*pSlot, globalEpoch);
+			ReclaimOrphans(globalEpoch);
+		}
+		return;
+	}
+
+	bool EpochReclaimer::Retire(void* pMem, MemoryPool& owner)
+	{
+		if (!pMem)
+			return true;
+
+		ParticipantSlot* pSlot = GetSlot();
+		if (!pSlot)
+			return false;//Out of participant slots, we can't track this chunk
+
+		//A list still holding an older epoch that maps to the same index is at least 3 epochs old, so it is safe.
+		//It is rare enough that freeing it here, inside the critical section, doesn't matter.
+		unsigned long long globalEpoch = m_globalEpoch.load(memory_order_acquire);
+		unsigned int index = (unsigned int)(globalEpoch % EPOCH_COUNT);
+		if (pSlot->m_retiredEpoch[index] != globalEpoch)
+		{
+			FreeRetiredList(pSlot->m_retired[index]);
+			pSlot->m_retiredEpoch[index] = globalEpoch;
+		}
+
+		RetiredChunk chunk;
+		chunk.m_pMem = pMem;
+		chunk.m_pOwner = &owner;
+		pSlot->m_retired[index].push_back(chunk);
+
+		if (pSlot->m_retired[index].size() >= RECLAIM_BATCH_SIZE)
+		{
+			if (pSlot->m_nestDepth > 0)
+				pSlot->m_isReclaimPending = true;//Picked up by ExitCritical
+			else
+				Flush();
+		}
+		return true;
+	}
+
+	void EpochReclaimer::Flush(void)
+	{
+		//Two advances are needed before the current epoch's list is safe. They fail while another thread lags behind.
+		for (unsigned int i = 0; i < EPOCH_COUNT - 1; i++)
+			TryAdvanceEpoch();
+		unsigned long long globalEpoch = m_globalEpoch.load(memory_order_acquire);
+
+		ParticipantSlot* pSlot = GetSlot();
+		if (pSlot)
+			ReclaimSafeLists(*pSlot, globalEpoch);
+		ReclaimOrphans(globalEpoch);
+		return;
+	}
+
+	void* EpochReclaimer::Alloc(MemoryPool& pool)
+	{
+		void* pMem = nullptr;
+		{
+			lock_guard<mutex> lock(m_poolLock);
+			pMem = pool.Alloc();
+		}
+		//The pool may be full of chunks waiting on an epoch. Give ours back and let the other threads catch up.
+		for (unsigned int retry = 0; !pMem && retry < ALLOC_RETRY_COUNT; retry++)
+		{
+			Flush();
+			lock_guard<mutex> lock(m_poolLock);
+			pMem = pool.Alloc();
+			if (!pMem)
+				this_thread::yield();
+		}
+		return pMem;
+	}
+
+	void EpochReclaimer::Free(void* pMem, MemoryPool& pool)
+	{
+		lock_guard<mutex> lock(m_poolLock);
+		pool.Free(pMem);
+		return;
+	}
+
+	EpochReclaimer::ParticipantSlot* EpochReclaimer::GetSlot(void)
+	{
+		//Remember the last slot this thread used so the common case doesn't scan
+		static thread_local EpochReclaimer* s_pCachedOwner = nullptr;
+		static thread_local ParticipantSlot* s_pCachedSlot = nullptr;
+
+		thread::id self = this_thread::get_id();
+		if (s_pCachedOwner == this && s_pCachedSlot->m_ownerThread.load(memory_order_relaxed) == self)
+			return s_pCachedSlot;
+
+		ParticipantSlot* pFound = nullptr;
+		for (unsigned int i = 0; i < MAX_PARTICIPANTS && !pFound; i++)
+		{
+			if (m_slots[i].m_isClaimed.load(memory_order_acquire) && m_slots[i].m_ownerThread.load(memory_order_relaxed) == self)
+				pFound = &m_slots[i];
+		}
+		for (unsigned int i = 0; i < MAX_PARTICIPANTS && !pFound; i++)
+		{
+			bool expected = false;
+			if (m_slots[i].m_isClaimed.compare_exchange_strong(expected, true, memory_order_acq_rel))
+			{
+				m_slots[i].m_ownerThread.store(self, memory_order_release);
+				pFound = &m_slots[i];
+
+				//Give the slot back when this thread exits. Drop what is left from a reclaimer that used to live here.
+				static thread_local ThreadSlotGuard s_slotGuard;
+				vector<ThreadSlotGuard::ClaimedSlot>& claimed = s_slotGuard.m_claimed;
+				for (size_t c = 0; c < claimed.size();)
+				{
+					if (claimed[c].m_pReclaimer == this)
+						claimed.erase(claimed.begin() + c);
+					else
+						c++;
+				}
+				ThreadSlotGuard::ClaimedSlot claim;
+				claim.m_pReclaimer = this;
+				claim.m_instanceId = m_instanceId;
+				claim.m_pSlot = pFound;
+				claimed.push_back(claim);
+			}
+		}
+
+		if (pFound)
+		{
+			s_pCachedOwner = this;
+			s_pCachedSlot = pFound;
+		}
+		return pFound;
+	}
+
+	bool EpochReclaimer::TryAdvanceEpoch(void)
+	{
+		//The epoch can only move forward once every thread inside a critical section has seen the current one
+		unsigned long long globalEpoch = m_globalEpoch.load(memory_order_seq_cst);
+		for (unsigned int i = 0; i < MAX_PARTICIPANTS; i++)
+		{
+			if (!m_slots[i].m_isClaimed.load(memory_order_acquire))
+				continue;
+			unsigned long long localEpoch = m_slots[i].m_localEpoch.load(memory_order_seq_cst);
+			if ((localEpoch & 1) && (localEpoch >> 1) != globalEpoch)
+				return false;
+		}
+		//Losing this race is fine, somebody else moved it forward
+		m_globalEpoch.compare_exchange_strong(globalEpoch, globalEpoch + 1, memory_order_seq_cst);
+		return true;
+	}
+
+	void EpochReclaimer::ReclaimSafeLists(ParticipantSlot& slot, unsigned long long globalEpoch)
+	{
+		for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+		{
+			if (!slot.m_retired[e].empty() && slot.m_retiredEpoch[e] + 2 <= globalEpoch)
+				FreeRetiredList(slot.m_retired[e]);
+		}
+		return;
+	}
+
+	void EpochReclaimer::FreeRetiredList(vector<RetiredChunk>& retired)
+	{
+		if (retired.empty())
+			return;
+
+		//One lock for the whole batch
+		lock_guard<mutex> lock(m_poolLock);
+		for (size_t i = 0; i < retired.size(); i++)
+			retired[i].m_pOwner->Free(retired[i].m_pMem);
+		retired.clear();
+		return;
+	}
+
+	void EpochReclaimer::ReleaseSlot(ParticipantSlot& slot)
+	{
+		//The owner is gone, so it can't be inside a critical section anymore
+		slot.m_nestDepth = 0;
+		slot.m_isReclaimPending = false;
+		slot.m_localEpoch.store(0, memory_order_release);
+
+		//Free what is already safe, hand the rest over so a Flush from any thread can free it later
+		for (unsigned int i = 0; i < EPOCH_COUNT - 1; i++)
+			TryAdvanceEpoch();
+		ReclaimSafeLists(slot, m_globalEpoch.load(memory_order_acquire));
+		{
+			lock_guard<mutex> lock(m_orphanLock);
+			for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+			{
+				if (slot.m_retired[e].empty())
+					continue;
+				if (m_orphaned[e].empty() || m_orphanedEpoch[e] == slot.m_retiredEpoch[e])
+				{
+					m_orphaned[e].insert(m_orphaned[e].end(), slot.m_retired[e].begin(), slot.m_retired[e].end());
+					m_orphanedEpoch[e] = slot.m_retiredEpoch[e];
+					slot.m_retired[e].clear();
+				}
+				else if (m_orphanedEpoch[e] < slot.m_retiredEpoch[e])
+				{
+					//Same index, different epoch: the older list is at least 3 epochs old and safe
+					FreeRetiredList(m_orphaned[e]);
+					m_orphaned[e].swap(slot.m_retired[e]);
+					m_orphanedEpoch[e] = slot.m_retiredEpoch[e];
+				}
+				else
+				{
+					FreeRetiredList(slot.m_retired[e]);
+				}
+			}
+		}
+
+		slot.m_ownerThread.store(thread::id(), memory_order_relaxed);
+		slot.m_isClaimed.store(false, memory_order_release);
+		return;
+	}
+
+	void EpochReclaimer::ReclaimOrphans(unsigned long long globalEpoch)
+	{
+		vector<RetiredChunk> safe;
+		{
+			lock_guard<mutex> lock(m_orphanLock);
+			for (unsigned int e = 0; e < EPOCH_COUNT; e++)
+			{
+				if (!m_orphaned[e].empty() && m_orphanedEpoch[e] + 2 <= globalEpoch)
+				{
+					safe.insert(safe.end(), m_orphaned[e].begin(), m_orphaned[e].end());
+					m_orphaned[e].clear();
+				}
+			}
+		}
+		FreeRetiredList(safe);
+		return;
+	}
+
+	EpochReclaimer::ReclaimerRegistry& EpochReclaimer::GetRegistry(void)
+	{
+		static ReclaimerRegistry s_registry;
+		return s_registry;
+	}
+
+	EpochReclaimer::ThreadSlotGuard::~ThreadSlotGuard(void)
+	{
+		//Holding the registry lock keeps the reclaimer from being destroyed while its slot is released
+		ReclaimerRegistry& registry = GetRegistry();
+		lock_guard<mutex> lock(registry.m_lock);
+		for (size_t c = 0; c < m_claimed.size(); c++)
+		{
+			map<EpochReclaimer*, unsigned long long>::iterator iter = registry.m_live.find(m_claimed[c].m_pReclaimer);
+			if (iter != registry.m_live.end() && iter->second == m_claimed[c].m_instanceId)
+				m_claimed[c].m_pReclaimer->ReleaseSlot(*m_claimed[c].m_pSlot);
+		}
+		return;
+	}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "MemoryPool.h"
+
+using namespace std;
+
+	/*
+		(1)
+		This class is an epoch based reclamation layer for lock free data structures whose nodes come from MemoryPool objects.
+		A node that was unlinked can't go back to its pool with MemoryPool::Free right away because another thread may still be
+		reading it. Instead the thread calls Retire(ptr, pool) and the node is freed once every thread that could have seen it
+		has left its critical section.
+
+		(2)
+		Every thread wraps its accesses to the shared structure in EnterCritical()/ExitCritical(). Entering publishes the global
+		epoch the thread is working in. The global epoch only moves forward when every thread inside a critical section has
+		caught up with it, so a node retired in epoch E can't be reached by anyone once the global epoch is E + 2.
+		Each thread keeps one retired list per epoch (mod 3) and hands a whole list back to the owning pools in one batch.
+
+		(3)
+		MemoryPool is not thread safe, so every pool used through a reclaimer must only be touched through Alloc/Free here,
+		which share one lock. Retired lists are freed under that lock a batch at a time. Each thread gets a participant slot
+		the first time it uses a reclaimer and gives it back when it exits. Whatever it retired that isn't safe yet is handed
+		to the reclaimer and freed by a later Flush from any thread. With MAX_PARTICIPANTS threads holding slots,
+		EnterCritical returns false and the caller must not touch the shared structure. The reclaimer must be destroyed
+		before its pools, and only when no thread is inside a critical section.
+	*/
+	class EpochReclaimer
+	{
+		const static unsigned int MAX_PARTICIPANTS = 64;
+		const static unsigned int EPOCH_COUNT = 3;				// Retired lists per thread, indexed by epoch % 3
+		const static size_t RECLAIM_BATCH_SIZE = 64;			// Try to move the epoch forward once a list gets this long
+		const static unsigned int ALLOC_RETRY_COUNT = 16;		// Flushes Alloc tries before it gives up on an empty pool
+
+		struct RetiredChunk
+		{
+			void* m_pMem;
+			MemoryPool* m_pOwner;
+		};
+
+		struct ParticipantSlot
+		{
+			atomic<bool> m_isClaimed;
+			atomic<thread::id> m_ownerThread;
+			atomic<unsigned long long> m_localEpoch;		// (epoch << 1) | 1 while inside a critical section, low bit clear outside
+			unsigned int m_nestDepth;						// Only touched by the owning thread from here on
+			bool m_isReclaimPending;						// Retire filled a list inside a critical section
+			vector<RetiredChunk> m_retired[EPOCH_COUNT];
+			unsigned long long m_retiredEpoch[EPOCH_COUNT];	// The epoch the chunks in m_retired[i] were retired in
+		};
+
+		//Releases the slots a thread claimed when the thread exits, if their reclaimer is still alive
+		struct ThreadSlotGuard
+		{
+			struct ClaimedSlot
+			{
+				EpochReclaimer* m_pReclaimer;
+				unsigned long long m_instanceId;	// Tells a live reclaimer from a new one at the same address
+				ParticipantSlot* m_pSlot;
+			};
+			vector<ClaimedSlot> m_claimed;
+			~ThreadSlotGuard(void);
+		};
+
+		//Every live reclaimer, so a guard never touches one that was already destroyed
+		struct ReclaimerRegistry
+		{
+			mutex m_lock;
+			map<EpochReclaimer*, unsigned long long> m_live;
+			unsigned long long m_nextInstanceId;
+			ReclaimerRegistry(void) : m_nextInstanceId(0) {}
+		};
+
+		ParticipantSlot m_slots[MAX_PARTICIPANTS];
+		atomic<unsigned long long> m_globalEpoch;
+		mutex m_poolLock;
+		unsigned long long m_instanceId;
+		mutex m_orphanLock;
+		vector<RetiredChunk> m_orphaned[EPOCH_COUNT];			// Lists handed over by exited threads, indexed like m_retired
+		unsigned long long m_orphanedEpoch[EPOCH_COUNT];
+
+	public:
+		//Construction
+		EpochReclaimer(void);
+		~EpochReclaimer(void);
+
+		//Critical sections. Nesting is allowed, only the outermost pair counts. EnterCritical returns false when every
+		//participant slot is taken, the thread is then not protected and must not call ExitCritical.
+		bool EnterCritical(void);
+		void ExitCritical(void);
+
+		//Reclamation
+		bool Retire(void* pMem, MemoryPool& owner);//Call from inside a critical section, after the chunk was unlinked. False if this
+													//thread has no slot, the chunk then still belongs to the caller.
+		void Flush(void);//Tries to move the epoch forward and frees whatever this thread has retired that is now safe
+
+		//Pool access, serialized with the batched frees
+		void* Alloc(MemoryPool& pool);//Flushes and retries a few times when the pool is out of chunks
+		void Free(void* pMem, MemoryPool& pool);//Immediate free, only for chunks no other thread can still see
+
+	private:
+		ParticipantSlot* GetSlot(void);
+		bool TryAdvanceEpoch(void);
+		void ReclaimSafeLists(ParticipantSlot& slot, unsigned long long globalEpoch);
+		void FreeRetiredList(vector<RetiredChunk>& retired);
+		void ReleaseSlot(ParticipantSlot& slot);
+		void ReclaimOrphans(unsigned long long globalEpoch);
+		static ReclaimerRegistry& GetRegistry(void);
+
+		//Don't allow copy constructor
+		EpochReclaimer(const EpochReclaimer& reclaimer) {}
+	};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "IoBufferPool.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+	IoBuffer::IoBuffer(const IoBuffer& buffer)
+	{
+		m_pPool = buffer.m_pPool;
+		m_pControl = buffer.m_pControl;
+		m_offset = buffer.m_offset;
+		m_length = buffer.m_length;
+		if (m_pControl)
+			m_pControl->m_refCount++;
+		return;
+	}
+
+	IoBuffer& IoBuffer::operator=(const IoBuffer& buffer)
+	{
+		if (this == &buffer)
+			return *this;
+
+		//Add the new reference first so assigning another slice of the same buffer doesn't free it
+		if (buffer.m_pControl)
+			buffer.m_pControl->m_refCount++;
+		Release();
+		m_pPool = buffer.m_pPool;
+		m_pControl = buffer.m_pControl;
+		m_offset = buffer.m_offset;
+		m_length = buffer.m_length;
+		return *this;
+	}
+
+	unsigned char* IoBuffer::GetData(void) const
+	{
+		return m_pControl ? (m_pControl->m_pData + m_offset) : nullptr;
+	}
+
+	IoBuffer IoBuffer::Slice(size_t offset, size_t length) const
+	{
+		IoBuffer slice;
+		if (!m_pControl || offset > m_length || length > m_length - offset)
+			return slice;
+
+		slice = *this;
+		slice.m_offset = m_offset + offset;
+		slice.m_length = length;
+		return slice;
+	}
+
+	void IoBuffer::Release(void)
+	{
+		if (m_pControl && --m_pControl->m_refCount == 0)
+			m_pPool->ReleaseBuffer(m_pControl);
+		m_pPool = nullptr;
+		m_pControl = nullptr;
+		m_offset = 0;
+		m_length = 0;
+		return;
+	}
+
+	bool IoBufferPool::Init(size_t bufferSize, unsigned int buffersPerBlock)
+	{
+		if (m_isPoolReady || bufferSize == 0 || buffersPerBlock == 0)
+			return false;
+
+		size_t pageSize = GetPageSize();
+		m_bufferSize = (bufferSize + pageSize - 1) / pageSize * pageSize;
+		if (m_bufferSize > 0xFFFFFFFFu)
+			return false;//MemoryPool chunk sizes are 32 bit
+
+		m_bufferPool.SetChunkTracking(CHUNK_TRACKING_BITMAP);
+		m_bufferPool.SetChunkAlignment(pageSize);
+		if (!m_bufferPool.Init((unsigned int)m_bufferSize, buffersPerBlock))
+			return false;
+		if (!m_controlPool.Init(sizeof(IoBuffer::IoBufferControl), buffersPerBlock))
+			return false;
+
+		m_isPoolReady = true;
+		return true;
+	}
+
+	IoBuffer IoBufferPool::Acquire(void)
+	{
+		IoBuffer buffer;
+		if (!m_isPoolReady)
+			return buffer;
+
+		unsigned char* pData = (unsigned char*)m_bufferPool.Alloc();
+		if (!pData)
+			return buffer;
+
+		IoBuffer::IoBufferControl* pControl = (IoBuffer::IoBufferControl*)m_controlPool.Alloc();
+		if (!pControl)
+		{
+			m_bufferPool.Free(pData);
+			return buffer;
+		}
+		pControl->m_pData = pData;
+		pControl->m_refCount = 1;
+
+		buffer.m_pPool = this;
+		buffer.m_pControl = pControl;
+		buffer.m_length = m_bufferSize;
+		return buffer;
+	}
+
+	void IoBufferPool::ReleaseBuffer(IoBuffer::IoBufferControl* pControl)
+	{
+		m_bufferPool.Free(pControl->m_pData);
+		m_controlPool.Free(pControl);
+		return;
+	}
+
+	size_t IoBufferPool::FillIoVec(const IoBuffer* pBuffers, size_t count, IoVec* pIoVec)
+	{
+		size_t filled = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!pBuffers[i].IsValid())
+				continue;
+			pIoVec[filled].iov_base = pBuffers[i].GetData();
+			pIoVec[filled].iov_len = pBuffers[i].GetLength();
+			filled++;
+		}
+		return filled;
+	}
+
+	size_t IoBufferPool::GetPageSize(void)
+	{
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return (size_t)info.dwPageSize;
+#else
+		long pageSize = sysconf(_SC_PAGESIZE);
+		return (pageSize > 0) ? (size_t)pageSize : 4096;
+#endif
+	}
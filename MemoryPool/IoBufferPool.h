@@ -0,0 +1,115 @@
+#pragma once
+
+#include "MemoryPool.h"
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+	/*
+		(1)
+		One entry of a scatter/gather list. On POSIX this is struct iovec itself so the array can go straight to readv/writev.
+		Windows has no readv, the same layout is kept so loaders can walk the list and issue one ReadFile per entry.
+	*/
+#ifdef _WIN32
+	struct IoVec
+	{
+		void* iov_base;
+		size_t iov_len;
+	};
+#else
+	typedef struct iovec IoVec;
+#endif
+
+	class IoBufferPool;
+
+	/*
+		(1)
+		A reference counted handle to a slice of one pooled I/O buffer. Copying the handle adds a reference and the buffer
+		goes back to its IoBufferPool when the last handle is destroyed. Slice() makes a handle to part of the same buffer,
+		which is how one read can be split between several consumers without copying.
+		Handles are not thread safe and must not outlive their IoBufferPool.
+	*/
+	class IoBuffer
+	{
+		friend class IoBufferPool;
+	public:
+		IoBuffer(void)
+		{
+			m_pPool = nullptr;
+			m_pControl = nullptr;
+			m_offset = 0;
+			m_length = 0;
+			return;
+		}
+		IoBuffer(const IoBuffer& buffer);
+		IoBuffer& operator=(const IoBuffer& buffer);
+		~IoBuffer(void)
+		{
+			Release();
+			return;
+		}
+
+		bool IsValid(void) const { return m_pControl != nullptr; }
+		unsigned char* GetData(void) const;
+		size_t GetLength(void) const { return m_length; }
+		IoBuffer Slice(size_t offset, size_t length) const;//Returns an invalid handle if the range is outside this slice
+		void Release(void);
+
+	private:
+		//Lives in the pool's control chunk, one per pooled buffer
+		struct IoBufferControl
+		{
+			unsigned char* m_pData;
+			unsigned int m_refCount;
+		};
+
+		IoBufferPool* m_pPool;
+		IoBufferControl* m_pControl;
+		size_t m_offset, m_length;
+	};
+
+	/*
+		(1)
+		This class hands out page aligned I/O buffers for O_DIRECT / FILE_FLAG_NO_BUFFERING reads and scatter/gather I/O.
+		MemoryPool's free list puts a link header in front of every chunk, so the data never starts on a page. Here the
+		buffers come from a bitmap tracked MemoryPool whose chunks are page aligned and whose chunk size is rounded up to a
+		whole number of pages, so every buffer address and length is a multiple of the disk block size as well.
+		The reference counts live in a second, small free list MemoryPool so the buffers themselves stay untouched.
+	*/
+	class IoBufferPool
+	{
+		friend class IoBuffer;
+
+		MemoryPool m_bufferPool;	// Page aligned, bitmap tracked
+		MemoryPool m_controlPool;	// IoBuffer::IoBufferControl chunks
+		size_t m_bufferSize;
+		bool m_isPoolReady;
+
+	public:
+		//Construction
+		IoBufferPool(void)
+		{
+			m_bufferSize = 0;
+			m_isPoolReady = false;
+			return;
+		}
+		//bufferSize is rounded up to a multiple of the page size. buffersPerBlock buffers are reserved each time the pool grows.
+		bool Init(size_t bufferSize, unsigned int buffersPerBlock);
+
+		//Allocation functions
+		IoBuffer Acquire(void);//Returns an invalid handle when the pool is out of buffers
+		size_t GetBufferSize(void) const { return m_bufferSize; }
+
+		//Fills pIoVec with one entry per buffer, returns the number of entries written (invalid handles are skipped)
+		static size_t FillIoVec(const IoBuffer* pBuffers, size_t count, IoVec* pIoVec);
+		static size_t GetPageSize(void);
+
+		//Settings
+		bool GetReadyStatus() { return m_isPoolReady; }
+
+	private:
+		void ReleaseBuffer(IoBuffer::IoBufferControl* pControl);
+
+		//Don't allow copy constructor
+		IoBufferPool(const IoBufferPool& pool) {}
+	};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MemoryPool.h"
+#include <cstring>
 
 	bool MemoryPool::AllocateRawMemoryArray(void)
 	{
@@ -25,10 +26,39 @@
 		m_chunkSize = chunkSize;
 		m_numChunks = numChunks;
 
+		if (m_chunkTracking == CHUNK_TRACKING_BITMAP)
+		{
+			//Header and bitmap are rounded up so the first chunk stays pointer aligned (or aligned to m_chunkAlignment)
+			m_bitmapWords = (m_numChunks + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+			m_blockHeaderSize = sizeof(BitmapBlockHeader) + sizeof(unsigned int) * m_bitmapWords;
+			size_t headerAlignment = (m_chunkAlignment > CHUNK_HEADER_SIZE) ? m_chunkAlignment : CHUNK_HEADER_SIZE;
+			m_blockHeaderSize = (m_blockHeaderSize + headerAlignment - 1) & ~(headerAlignment - 1);
+		}
+
 		m_isMemPoolReady = GrowMemoryArray(m_memArraySize);
 		return  m_isMemPoolReady;
 	}
 
+	bool MemoryPool::SetChunkTracking(ChunkTracking tracking)
+	{
+		//The block layout depends on the tracking, so it can't change once blocks exist
+		if (m_isMemPoolReady || m_ppRawMemoryArray)
+			return false;
+		m_chunkTracking = tracking;
+		return true;
+	}
+
+	bool MemoryPool::SetChunkAlignment(size_t alignment)
+	{
+		//Free list chunks sit behind a link header, so only bitmap tracked chunks can be aligned
+		if (m_isMemPoolReady || m_ppRawMemoryArray || m_chunkTracking != CHUNK_TRACKING_BITMAP)
+			return false;
+		if (alignment & (alignment - 1))
+			return false;//Not a power of 2
+		m_chunkAlignment = alignment;
+		return true;
+	}
+
 	bool MemoryPool::GrowMemoryArray(int initialMemoryArraySize)
 	{
 		try
@@ -43,28 +73,39 @@
 				if (!ppNewMemArray)
 					return false;
 
+				//Allocate the new block before touching the current array, so a failure leaves the pool as it was
+				unsigned char* pNewBlock = AllocateNewMemoryBlock();
+				if (!pNewBlock)
+				{
+					free(ppNewMemArray);
+					return false;
+				}
+
 				//Copy any existing memeory pointers over
 				for (unsigned int i = 0; i < m_memArraySize; i++)
 				{
 					ppNewMemArray[i] = m_ppRawMemoryArray[i];
 				}
 
-				//Allocate a new block of memory.  Indexing m_memArraySize here is 
-				//safe because we haven't incremented it yet to reflect the new size
-				ppNewMemArray[m_memArraySize] = AllocateNewMemoryBlock();
+				//Indexing m_memArraySize here is safe because we haven't incremented it yet to reflect the new size
+				ppNewMemArray[m_memArraySize] = pNewBlock;
+				pNewBlock = nullptr;
 
-				//Attach the block to the end of the current memory list
-				unsigned char* pCurr = (unsigned char*)m_pHead;//Cast here, we will still pass over the correct memory address
-				unsigned char* pNext = GetNext((unsigned char*)m_pHead);
-				while (pNext)
+				//Attach the block to the end of the current memory list. Bitmap tracked blocks are not linked.
+				if (m_chunkTracking == CHUNK_TRACKING_FREE_LIST)
 				{
-					pCurr = pNext;
-					pNext = GetNext(pNext);
-				}
+					unsigned char* pCurr = (unsigned char*)m_pHead;//Cast here, we will still pass over the correct memory address
+					unsigned char* pNext = GetNext((unsigned char*)m_pHead);
+					while (pNext)
+					{
+						pCurr = pNext;
+						pNext = GetNext(pNext);
+					}
 
-				SetNext(pCurr, ppNewMemArray[m_memArraySize]);
-				pCurr = nullptr;
-				pNext = nullptr;
+					SetNext(pCurr, ppNewMemArray[m_memArraySize]);
+					pCurr = nullptr;
+					pNext = nullptr;
+				}
 
 				//Deallocate the old memory array by first setting it's elements to null because the new array is pointing to
 				//those locations.
@@ -81,15 +122,27 @@
 				//Assign the raw memory pointer to the new allocation
 				m_ppRawMemoryArray = ppNewMemArray;
 				ppNewMemArray = nullptr;//Set the temporary pointer to null now.
-				m_pHead = (unsigned char**)m_ppRawMemoryArray[m_memArraySize];//Head must point directly to the first free chunk
+				if (m_chunkTracking == CHUNK_TRACKING_FREE_LIST)
+					m_pHead = (unsigned char**)m_ppRawMemoryArray[m_memArraySize];//Head must point directly to the first free chunk
 			}
 			else
 			{
-				AllocateRawMemoryArray();
+				if (!AllocateRawMemoryArray())
+					return false;
 				for (unsigned int i = 0; i < m_memArraySize; i++)
 				{
 					m_ppRawMemoryArray[i] = AllocateNewMemoryBlock();
-					if (i > 0)
+					if (!m_ppRawMemoryArray[i])
+					{
+						//Give back the blocks we already got, the pool is not usable without all of them
+						for (unsigned int j = 0; j < i; j++)
+							FreeBlockMemory(m_ppRawMemoryArray[j]);
+						free(m_ppRawMemoryArray);
+						m_ppRawMemoryArray = nullptr;
+						m_pHead = nullptr;
+						return false;
+					}
+					if (i > 0 && m_chunkTracking == CHUNK_TRACKING_FREE_LIST)
 					{
 						//Need to connect each new block to the previously allocated block.
 						unsigned char* pCurr = m_ppRawMemoryArray[i - 1];
@@ -104,7 +157,8 @@
 						pNext = nullptr;
 					}
 				}
-				m_pHead = (unsigned char**)m_ppRawMemoryArray[0];//Set head to the first chunk
+				if (m_chunkTracking == CHUNK_TRACKING_FREE_LIST)
+					m_pHead = (unsigned char**)m_ppRawMemoryArray[0];//Set head to the first chunk
 			}
 
 			//Increment the size count if this is not the initialization
@@ -125,12 +179,33 @@
 	{
 		try
 		{
+			if (m_chunkTracking == CHUNK_TRACKING_BITMAP)
+			{
+				//Chunks are packed back to back after the header, there is no per chunk link
+				unsigned char* pNewBlock = AllocateBlockMemory(m_blockHeaderSize + (size_t)m_chunkSize * m_numChunks);
+				if (!pNewBlock)
+					return nullptr;
+
+				BitmapBlockHeader* pHeader = GetBlockHeader(pNewBlock);
+				pHeader->m_usedChunks = 0;
+				pHeader->m_firstFreeWord = 0;
+
+				//Mark every chunk free. Bits past m_numChunks in the last word stay 0 so they are never handed out.
+				unsigned int* pBitmap = GetBlockBitmap(pNewBlock);
+				for (unsigned int i = 0; i < m_bitmapWords; i++)
+				{
+					unsigned int bitsInWord = m_numChunks - i * BITMAP_WORD_BITS;
+					pBitmap[i] = (bitsInWord >= BITMAP_WORD_BITS) ? 0xFFFFFFFFu : ((1u << bitsInWord) - 1);
+				}
+				return pNewBlock;
+			}
+
 			//Calculate the size of each block and the size of the actual memory allocation
 			size_t miniBlockSize = m_chunkSize + CHUNK_HEADER_SIZE;// chunk + linked list overhead
 			size_t trueSize = miniBlockSize * m_numChunks;
 
 			//Allocate the memory
-			unsigned char* pNewMem = (unsigned char*)malloc(trueSize);
+			unsigned char* pNewMem = AllocateBlockMemory(trueSize);
 			if (!pNewMem)
 				return nullptr;
 
@@ -161,11 +236,43 @@
 		}
 	}
 	 
+	unsigned char* MemoryPool::AllocateBlockMemory(size_t size)
+	{
+		if (m_chunkAlignment == 0)
+			return (unsigned char*)malloc(size);
+#ifdef _MSC_VER
+		return (unsigned char*)_aligned_malloc(size, m_chunkAlignment);
+#else
+		void* pBlock = nullptr;
+		size_t alignment = (m_chunkAlignment < sizeof(void*)) ? sizeof(void*) : m_chunkAlignment;
+		return (posix_memalign(&pBlock, alignment, size) == 0) ? (unsigned char*)pBlock : nullptr;
+#endif
+	}
+
+	void MemoryPool::FreeBlockMemory(unsigned char* pBlock)
+	{
+#ifdef _MSC_VER
+		if (m_chunkAlignment != 0)
+		{
+			_aligned_free(pBlock);
+			return;
+		}
+#endif
+		free(pBlock);
+		return;
+	}
+
 	void MemoryPool::Destroy(void)
 	{
 		if (m_ppRawMemoryArray)
 		{
-			 
+			//Free the blocks still owned by this array. GrowMemoryArray sets them to NULL when they moved to a new array.
+			for (unsigned int i = 0; i < m_memArraySize; i++)
+			{
+				if (m_ppRawMemoryArray[i])
+					FreeBlockMemory(m_ppRawMemoryArray[i]);
+				m_ppRawMemoryArray[i] = nullptr;
+			}
 			free(m_ppRawMemoryArray);
 			m_ppRawMemoryArray = nullptr;
 			 
@@ -177,6 +284,9 @@
 	{
 		try
 		{
+			if (m_chunkTracking == CHUNK_TRACKING_BITMAP)
+				return AllocFromBitmap();
+
 			//If we're out of memory chunks, grow the pool. This is very expensive. Remember, head points to the next free chunk.
 			//So if this is null, we are out of free chunks.
 			if (!(m_pHead))
@@ -211,7 +321,12 @@
 			//Calling Free() on a NULL pointer is perfectly valid C++ so we have to check for it.
 			if (pMem)
 			{
-				
+				if (m_chunkTracking == CHUNK_TRACKING_BITMAP)
+				{
+					FreeToBitmap(pMem);
+					return;
+				}
+
 				//The pointer we get back is just to the data section of the chunk. 
 				//This gets us the full chunk. (Seek backwards past the chunk header)
 				unsigned char* pBlock = ((unsigned char*)pMem) - CHUNK_HEADER_SIZE; 
@@ -232,13 +347,13 @@
 	{
 		try
 		{
-			m_memArraySize = MEMORY_ARRAY_SIZE;
-			m_memArrayMaxSize = MAX_MEMORY_ARRAY_SIZE;
 			m_pHead = nullptr;
 			if (m_ppRawMemoryArray)
 			{
 				Destroy();
 			}
+			m_memArraySize = MEMORY_ARRAY_SIZE;//After Destroy, it needs the old size to free every block
+			m_memArrayMaxSize = MAX_MEMORY_ARRAY_SIZE;
 			GrowMemoryArray(m_memArraySize);
 			return;
 		}
@@ -279,9 +394,221 @@
 	}
 
 	
-	
+
+	void* MemoryPool::AllocFromBitmap(void)
+	{
+		//Prefer the fullest block that still has room, this keeps the other blocks draining towards empty.
+		int bestBlock = -1;
+		unsigned int bestUsed = 0;
+		for (unsigned int i = 0; i < m_memArraySize; i++)
+		{
+			unsigned int used = GetBlockHeader(m_ppRawMemoryArray[i])->m_usedChunks;
+			if (used < m_numChunks && (bestBlock < 0 || used > bestUsed))
+			{
+				bestBlock = (int)i;
+				bestUsed = used;
+			}
+		}
+
+		if (bestBlock < 0)
+		{
+			//Every block is full, same growth rules as the free list
+			if (!m_toAllowResize || m_memArraySize >= m_memArrayMaxSize)
+				return nullptr;
+			if (!GrowMemoryArray())
+				return nullptr;
+			bestBlock = (int)m_memArraySize - 1;//The new block is always appended
+		}
+
+		//Take the lowest free chunk so consecutive allocations are adjacent
+		unsigned char* pBlock = m_ppRawMemoryArray[bestBlock];
+		BitmapBlockHeader* pHeader = GetBlockHeader(pBlock);
+		unsigned int* pBitmap = GetBlockBitmap(pBlock);
+		for (unsigned int w = pHeader->m_firstFreeWord; w < m_bitmapWords; w++)
+		{
+			if (pBitmap[w])
+			{
+				unsigned int bit = LowestSetBit(pBitmap[w]);
+				pBitmap[w] &= ~(1u << bit);
+				pHeader->m_usedChunks++;
+				pHeader->m_firstFreeWord = w;
+				return GetBlockChunks(pBlock) + (size_t)(w * BITMAP_WORD_BITS + bit) * m_chunkSize;
+			}
+		}
+		return nullptr;//The used count said there was room, this should never happen
+	}
+
+	void MemoryPool::FreeToBitmap(void* pMem)
+	{
+		int blockIndex = FindOwningBlock(pMem);
+		if (blockIndex < 0)
+			return;//Not one of ours
+
+		unsigned char* pBlock = m_ppRawMemoryArray[blockIndex];
+		BitmapBlockHeader* pHeader = GetBlockHeader(pBlock);
+		unsigned int chunkIndex = (unsigned int)(((unsigned char*)pMem - GetBlockChunks(pBlock)) / m_chunkSize);
+		unsigned int w = chunkIndex / BITMAP_WORD_BITS;
+		unsigned int bitMask = 1u << (chunkIndex % BITMAP_WORD_BITS);
+
+		if (GetBlockBitmap(pBlock)[w] & bitMask)
+			return;//Already free
+
+		GetBlockBitmap(pBlock)[w] |= bitMask;
+		pHeader->m_usedChunks--;
+		if (w < pHeader->m_firstFreeWord)
+			pHeader->m_firstFreeWord = w;
+		return;
+	}
+
+	int MemoryPool::FindOwningBlock(void* pMem)
+	{
+		//Free list chunks are found by their header, bitmap chunks by their data. Both lie inside the chunk area of the block.
+		unsigned char* p = (unsigned char*)pMem;
+		size_t chunkBytes = GetChunkStride() * m_numChunks;
+		for (unsigned int i = 0; i < m_memArraySize; i++)
+		{
+			unsigned char* pChunks = GetBlockChunks(m_ppRawMemoryArray[i]);
+			if (p >= pChunks && p < pChunks + chunkBytes)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	unsigned int MemoryPool::TrimEmptyBlocks(void)
+	{
+		if (!m_ppRawMemoryArray || m_memArraySize <= 1)
+			return 0;
+
+		//Count the free chunks of every block. The free list has to be walked to find out which block each free chunk is in.
+		vector<unsigned int> freeChunks(m_memArraySize, 0);
+		if (m_chunkTracking == CHUNK_TRACKING_BITMAP)
+		{
+			for (unsigned int i = 0; i < m_memArraySize; i++)
+				freeChunks[i] = m_numChunks - GetBlockHeader(m_ppRawMemoryArray[i])->m_usedChunks;
+		}
+		else
+		{
+			for (unsigned char* pChunk = (unsigned char*)m_pHead; pChunk; pChunk = GetNext(pChunk))
+			{
+				int blockIndex = FindOwningBlock(pChunk);
+				if (blockIndex >= 0)
+					freeChunks[blockIndex]++;
+			}
+		}
+
+		//Release every empty block, but always keep one
+		vector<bool> toRelease(m_memArraySize, false);
+		unsigned int released = 0;
+		for (unsigned int i = 0; i < m_memArraySize; i++)
+		{
+			toRelease[i] = (freeChunks[i] == m_numChunks);
+			if (toRelease[i])
+				released++;
+		}
+		if (released == m_memArraySize)
+		{
+			toRelease[m_memArraySize - 1] = false;
+			released--;
+		}
+		if (released == 0)
+			return 0;
+
+		//Unlink the released blocks' chunks from the free list, keeping the order of the rest
+		if (m_chunkTracking == CHUNK_TRACKING_FREE_LIST)
+		{
+			unsigned char* pPrev = nullptr;
+			unsigned char* pChunk = (unsigned char*)m_pHead;
+			while (pChunk)
+			{
+				unsigned char* pNext = GetNext(pChunk);
+				int blockIndex = FindOwningBlock(pChunk);
+				if (blockIndex < 0 || !toRelease[blockIndex])
+				{
+					if (pPrev)
+						SetNext(pPrev, pChunk);
+					else
+						m_pHead = (unsigned char**)pChunk;
+					pPrev = pChunk;
+				}
+				pChunk = pNext;
+			}
+			if (pPrev)
+				SetNext(pPrev, nullptr);
+			else
+				m_pHead = nullptr;
+		}
+
+		unsigned int kept = 0;
+		for (unsigned int i = 0; i < m_memArraySize; i++)
+		{
+			if (toRelease[i])
+				FreeBlockMemory(m_ppRawMemoryArray[i]);
+			else
+				m_ppRawMemoryArray[kept++] = m_ppRawMemoryArray[i];
+		}
+		m_memArraySize = kept;
+		return released;
+	}
+
+	bool MemoryPool::HasFreeChunk(void)
+	{
+		if (m_chunkTracking == CHUNK_TRACKING_FREE_LIST)
+			return m_pHead != nullptr;
+
+		for (unsigned int i = 0; i < m_memArraySize; i++)
+		{
+			if (GetBlockHeader(m_ppRawMemoryArray[i])->m_usedChunks < m_numChunks)
+				return true;
+		}
+		return false;
+	}
+
+	bool MemoryPool::TryExtendInPlace(void* pMem, unsigned int spanChunks, unsigned int newSpanChunks)
+	{
+		if (m_chunkTracking != CHUNK_TRACKING_BITMAP || newSpanChunks <= spanChunks)
+			return false;
+
+		int blockIndex = FindOwningBlock(pMem);
+		if (blockIndex < 0)
+			return false;
+
+		//The span can't run past the end of its block
+		unsigned char* pBlock = m_ppRawMemoryArray[blockIndex];
+		unsigned int firstChunk = (unsigned int)(((unsigned char*)pMem - GetBlockChunks(pBlock)) / m_chunkSize);
+		if (firstChunk + newSpanChunks > m_numChunks)
+			return false;
+
+		unsigned int* pBitmap = GetBlockBitmap(pBlock);
+		for (unsigned int i = firstChunk + spanChunks; i < firstChunk + newSpanChunks; i++)
+		{
+			if (!(pBitmap[i / BITMAP_WORD_BITS] & (1u << (i % BITMAP_WORD_BITS))))
+				return false;//A neighbor is in use
+		}
+		for (unsigned int i = firstChunk + spanChunks; i < firstChunk + newSpanChunks; i++)
+			pBitmap[i / BITMAP_WORD_BITS] &= ~(1u << (i % BITMAP_WORD_BITS));
+		GetBlockHeader(pBlock)->m_usedChunks += newSpanChunks - spanChunks;
+		return true;
+	}
+
+	void MemoryPool::FreeSpan(void* pMem, unsigned int spanChunks)
+	{
+		//Free list chunks never form spans
+		if (m_chunkTracking != CHUNK_TRACKING_BITMAP || spanChunks <= 1)
+		{
+			Free(pMem);
+			return;
+		}
+		for (unsigned int i = 0; i < spanChunks; i++)
+			FreeToBitmap((unsigned char*)pMem + (size_t)i * m_chunkSize);
+		return;
+	}
 
 	bool MemoryPoolManager::AllocateChunk(void *& ptr, size_t allocSize)
+	{
+		return AllocateChunk(ptr, allocSize, nullptr, 0);
+	}
+
+	bool MemoryPoolManager::AllocateChunk(void *& ptr, size_t allocSize, const type_info* p_typeInfo, size_t alignment)
 	{
 		MemoryPool* p_memPool = nullptr;
 		MemPoolMangrContext* p_context = nullptr;
@@ -294,18 +621,18 @@
 			p_context = &(m_ValidationMapIter->second);
 
 			//Return false if they are trying to allocate memory they already have.
-			if (p_context->m_MemoryChunkSize == allocSize && p_context->p_MemoryAddress == ptr)
+			if (p_context->m_MemoryChunkSize == allocSize && p_context->m_IsTyped == (p_typeInfo != nullptr) && (!p_typeInfo || *p_context->p_TypeInfo == *p_typeInfo) && p_context->p_MemoryAddress == ptr)
 				return false;
 
 			//If this context contains any kind of allocated memory we must free it first.
 			if (p_context->p_MemoryAddress)
 			{ 
-				m_MainMapIter = m_MainMap.find(p_context->m_MemoryChunkSize);
-				if(m_MainMapIter != m_MainMap.end())
-					m_MainMapIter->second.Free(p_context->p_MemoryAddress);
+				p_memPool = FindPool(*p_context);
+				if (p_memPool)
+					p_memPool->FreeSpan(p_context->p_MemoryAddress, p_context->m_SpanChunks);
 				p_context->m_MemoryChunkSize = 0;
 				p_context->p_MemoryAddress = nullptr;
-				m_MainMapIter = m_MainMap.end();
+				p_memPool = nullptr;
 			}
 
 			//Delete the old entry and start fresh
@@ -313,25 +640,43 @@
 			p_context = nullptr;
 		}
 		 
-		//Is this memory pool already in the map?  
-		m_MainMapIter = m_MainMap.find(allocSize);
-		//MemoryPool obj_memPool;
-		if (m_MainMapIter != m_MainMap.end())
+		p_memPool = GetOrCreatePool(allocSize, p_typeInfo, alignment);
+		if (!p_memPool)
 		{
-			p_memPool = &(m_MainMapIter->second); 
+			ptr = nullptr;
+			return false;
 		}
-		else
+
+		p_Alloc = AllocateFromPool(p_memPool, allocSize, p_typeInfo);
+		if (!p_Alloc)
 		{
-			MemoryPool obj_memPool;
-			m_MainMap[allocSize] = obj_memPool; //Do this first before "Init", because map stores a copy of the object
-												//and it will duplicate the allocated "memorypool raw pointer". Don't want free to
-												//get called multiple times on the same pointer in memorypool destructor.
-			if (m_MainMap[allocSize].Init(allocSize, BLOCK_SIZE_TIER1))
-				p_memPool = &m_MainMap[allocSize];
-			else
-				return false;
+			//No more memory to give out :)
+			ptr = nullptr;
+			return false;
 		}
+		
+		 
+		//Cool I got a chunk. Now I'll create a validation mapping
+		MemPoolMangrContext obj_context(allocSize, p_Alloc, p_typeInfo);
+		m_ValidationMap[&ptr] = obj_context;
+		ptr =  p_Alloc;   
 		 
+		m_ValidationMapIter = m_ValidationMap.end();
+		m_MainMapIter = m_MainMap.end();
+
+		//Last, because the pressure callbacks may allocate and deallocate themselves
+		CheckSoftLimits(p_memPool, allocSize, p_typeInfo);
+		return true;
+	}
+
+	void* MemoryPoolManager::AllocateFromPool(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo)
+	{
+		void* p_Alloc = nullptr;
+
+		//Growing the pool costs one more block, make sure the budgets allow that before it happens
+		if (!p_memPool->HasFreeChunk() && !EnforceHardLimits(p_memPool, allocSize, p_typeInfo, p_memPool->GetBlockBytes()))
+			return nullptr;
+
 		//Allocate the requested memory. I need to turn off the "allow resize" if garbage collection is on 
 		//so that the collection has a chance to run before the memory pool is extended.
 		bool b_InitialResizeState = p_memPool->GetAllowResize();
@@ -346,22 +691,8 @@
 			//Retry the allocation
 			p_Alloc = p_memPool->Alloc();
 		}
-		if (!p_Alloc)
-		{
-			//No more memory to give out :)
-			ptr = nullptr;
-			return false;
-		}
-		
-		 
-		//Cool I got a chunk. Now I'll create a validation mapping
-		MemPoolMangrContext obj_context(allocSize, p_Alloc);
-		m_ValidationMap[&ptr] = obj_context;
-		ptr =  p_Alloc;   
-		 
-		m_ValidationMapIter = m_ValidationMap.end();
-		m_MainMapIter = m_MainMap.end();
-		return true;
+		p_memPool->SetAllowResize(b_InitialResizeState);//Also when the first try worked, or the pool could never grow again
+		return p_Alloc;
 	}
 
 	bool MemoryPoolManager::DeallocateChunk(void*& ptr)
@@ -374,9 +705,9 @@
 			return false;
 
 		//It is Cool :), now I'll free it's memory....if I need to :)
-		m_MainMapIter = m_MainMap.find(m_ValidationMapIter->second.m_MemoryChunkSize);
-		if (m_MainMapIter != m_MainMap.end())
-			m_MainMapIter->second.Free(ptr);
+		MemoryPool* p_memPool = FindPool(m_ValidationMapIter->second);
+		if (p_memPool)
+			p_memPool->FreeSpan(ptr, m_ValidationMapIter->second.m_SpanChunks);
 
 		//Remove it from the validation mapping
 		m_ValidationMap.erase(m_ValidationMapIter); 
@@ -389,6 +720,82 @@
 		return true;
 	}
 
+	bool MemoryPoolManager::ReallocateChunk(void*& ptr, size_t newSize)
+	{
+		//Is this pointer valid? 
+		m_ValidationMapIter = m_ValidationMap.find(&ptr);
+		bool valid = (m_ValidationMapIter != m_ValidationMap.end()) && (ptr == m_ValidationMapIter->second.p_MemoryAddress);
+		if (!valid || newSize == 0)
+			return false;
+
+		//MemoryPool chunk sizes are 32 bit
+		if (newSize > 0xFFFFFFFFu)
+			return false;
+
+		//Typed chunks hold a T, they don't change size
+		MemPoolMangrContext* p_context = &(m_ValidationMapIter->second);
+		m_ValidationMapIter = m_ValidationMap.end();
+		if (p_context->m_IsTyped)
+			return false;
+
+		MemoryPool* p_memPool = FindPool(*p_context);
+		if (!p_memPool)
+			return false;
+
+		//A chunk from AllocateChunk(ptr, 0) never fits anything, it always goes to the copy (of 0 bytes)
+		size_t chunkSize = p_context->m_MemoryChunkSize;
+		if (chunkSize != 0)
+		{
+			size_t neededChunks = (newSize + chunkSize - 1) / chunkSize;
+
+			//Still fits: same chunk. Give back the tail of a span that grew earlier.
+			if (neededChunks <= p_context->m_SpanChunks)
+			{
+				if (neededChunks < p_context->m_SpanChunks)
+				{
+					p_memPool->FreeSpan((unsigned char*)ptr + neededChunks * chunkSize, p_context->m_SpanChunks - (unsigned int)neededChunks);
+					p_context->m_SpanChunks = (unsigned int)neededChunks;
+				}
+				return true;
+			}
+
+			//Grow into the free chunks right after this one
+			if (p_memPool->TryExtendInPlace(ptr, p_context->m_SpanChunks, (unsigned int)neededChunks))
+			{
+				p_context->m_SpanChunks = (unsigned int)neededChunks;
+				return true;
+			}
+		}
+
+		//Copy to a chunk of the next power of two. Growing a few bytes at a time then only copies when the size doubles,
+		//and it doesn't leave a pool behind for every size on the way.
+		size_t targetSize = 1;
+		while (targetSize < newSize && targetSize <= 0x7FFFFFFFu)
+			targetSize <<= 1;
+		if (targetSize < newSize)
+			targetSize = newSize;//Past the largest 32 bit power of two, the exact size still fits in 32 bits
+
+		MemoryPool* p_newPool = GetOrCreatePool(targetSize, nullptr, 0);
+		if (!p_newPool)
+			return false;
+		void* p_Alloc = AllocateFromPool(p_newPool, targetSize, nullptr);
+		if (!p_Alloc)
+			return false;
+
+		size_t oldSize = chunkSize * p_context->m_SpanChunks;
+		memcpy(p_Alloc, ptr, (oldSize < newSize) ? oldSize : newSize);
+		p_memPool->FreeSpan(ptr, p_context->m_SpanChunks);
+
+		//Point the validation mapping at the new chunk
+		p_context->m_MemoryChunkSize = targetSize;
+		p_context->p_MemoryAddress = p_Alloc;
+		p_context->m_SpanChunks = 1;
+		ptr = p_Alloc;
+
+		CheckSoftLimits(p_newPool, targetSize, nullptr);
+		return true;
+	}
+
 	void MemoryPoolManager::CollectAbandonedMemory(void)
 	{
 		//For each pointer in the validation mapping, see if it is abandoned. If so free the memory
@@ -411,9 +818,209 @@
 
 	void MemoryPoolManager::FreeAbandonedMemory(MemPoolMangrContext& context)
 	{
-		MainMappingTypeIter itr = m_MainMap.find(context.m_MemoryChunkSize);
-		if (itr != m_MainMap.end())
-			itr->second.Free(context.p_MemoryAddress); 
+		MemoryPool* p_memPool = FindPool(context);
+		if (p_memPool)
+			p_memPool->FreeSpan(context.p_MemoryAddress, context.m_SpanChunks); 
+		return;
+	}
+
+	MemoryPool* MemoryPoolManager::GetOrCreatePool(size_t allocSize, const type_info* p_typeInfo, size_t alignment)
+	{
+		//Untyped pools are keyed by chunk size, typed pools by the type
+		MemoryPool* p_memPool = nullptr;
+		unsigned int numChunks = BLOCK_SIZE_TIER1;
+		MemoryPool obj_memPool;
+		if (p_typeInfo)
+		{
+			//Is this memory pool already in the map?
+			TypedMappingTypeIter iter = m_TypedMap.find(type_index(*p_typeInfo));
+			if (iter != m_TypedMap.end())
+				return &(iter->second);
+
+			m_TypedMap[type_index(*p_typeInfo)] = obj_memPool;//Insert before "Init", see below
+			p_memPool = &m_TypedMap[type_index(*p_typeInfo)];
+
+			//Typed pools are always bitmap tracked so ForEach<T>() can walk them. Chunks are packed back to back and
+			//sizeof(T) is a multiple of alignof(T), so aligning the first chunk aligns them all.
+			p_memPool->SetChunkTracking(CHUNK_TRACKING_BITMAP);
+			p_memPool->SetChunkAlignment(alignment);
+			numChunks = BLOCK_SIZE_TYPED;
+		}
+		else
+		{
+			//Is this memory pool already in the map?  
+			MainMappingTypeIter iter = m_MainMap.find(allocSize);
+			if (iter != m_MainMap.end())
+				return &(iter->second);
+
+			m_MainMap[allocSize] = obj_memPool; //Do this first before "Init", because map stores a copy of the object
+												//and it will duplicate the allocated "memorypool raw pointer". Don't want free to
+												//get called multiple times on the same pointer in memorypool destructor.
+			p_memPool = &m_MainMap[allocSize];
+
+			p_memPool->SetChunkTracking(m_ChunkTracking);
+			//A bitmap over a single chunk block buys nothing, so bitmap tracked pools start with bigger blocks.
+			if (m_ChunkTracking == CHUNK_TRACKING_BITMAP)
+				numChunks = BLOCK_SIZE_TIER3;
+		}
+
+		//Init already reserves the first block, take it back if that fails or breaks a budget
+		if (!p_memPool->Init((unsigned int)allocSize, numChunks) || !EnforceHardLimits(p_memPool, allocSize, p_typeInfo, 0))
+		{
+			if (p_typeInfo)
+				m_TypedMap.erase(type_index(*p_typeInfo));
+			else
+				m_MainMap.erase(allocSize);
+			return nullptr;
+		}
+		return p_memPool;
+	}
+
+	MemoryPool* MemoryPoolManager::FindPool(const MemPoolMangrContext& context)
+	{
+		if (!context.m_IsTyped)
+		{
+			MainMappingTypeIter iter = m_MainMap.find(context.m_MemoryChunkSize);
+			return (iter != m_MainMap.end()) ? &(iter->second) : nullptr;
+		}
+		TypedMappingTypeIter iter = m_TypedMap.find(type_index(*context.p_TypeInfo));
+		return (iter != m_TypedMap.end()) ? &(iter->second) : nullptr;
+	}
+
+	void MemoryPoolManager::SetGlobalBudget(size_t softLimitBytes, size_t hardLimitBytes)
+	{
+		SetBudget(m_GlobalBudget, softLimitBytes, hardLimitBytes);
+		return;
+	}
+
+	void MemoryPoolManager::SetPoolBudget(size_t allocSize, size_t softLimitBytes, size_t hardLimitBytes)
+	{
+		SetBudget(m_PoolBudgets[allocSize], softLimitBytes, hardLimitBytes);
+		return;
+	}
+
+	size_t MemoryPoolManager::GetReservedBytes(void)
+	{
+		size_t reservedBytes = 0;
+		for (MainMappingTypeIter iter = m_MainMap.begin(); iter != m_MainMap.end(); iter++)
+			reservedBytes += iter->second.GetReservedBytes();
+		for (TypedMappingTypeIter iter = m_TypedMap.begin(); iter != m_TypedMap.end(); iter++)
+			reservedBytes += iter->second.GetReservedBytes();
+		return reservedBytes;
+	}
+
+	unsigned int MemoryPoolManager::TrimEmptyBlocks(void)
+	{
+		unsigned int released = 0;
+		for (MainMappingTypeIter iter = m_MainMap.begin(); iter != m_MainMap.end(); iter++)
+			released += iter->second.TrimEmptyBlocks();
+		for (TypedMappingTypeIter iter = m_TypedMap.begin(); iter != m_TypedMap.end(); iter++)
+			released += iter->second.TrimEmptyBlocks();
+		return released;
+	}
+
+	void MemoryPoolManager::SetBudget(MemoryBudget& budget, size_t softLimitBytes, size_t hardLimitBytes)
+	{
+		budget.m_softLimitBytes = softLimitBytes;
+		budget.m_hardLimitBytes = hardLimitBytes;
+		budget.m_isSoftLimitSignaled = false;
+		return;
+	}
+
+	MemoryPoolManager::MemoryBudget* MemoryPoolManager::FindBudget(size_t allocSize, const type_info* p_typeInfo)
+	{
+		if (p_typeInfo)
+		{
+			TypeBudgetMappingType::iterator iter = m_TypeBudgets.find(type_index(*p_typeInfo));
+			return (iter != m_TypeBudgets.end()) ? &(iter->second) : nullptr;
+		}
+		BudgetMappingType::iterator iter = m_PoolBudgets.find(allocSize);
+		return (iter != m_PoolBudgets.end()) ? &(iter->second) : nullptr;
+	}
+
+	bool MemoryPoolManager::FitsHardLimits(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo, size_t extraBytes)
+	{
+		MemoryBudget* p_budget = FindBudget(allocSize, p_typeInfo);
+		if (p_budget && p_budget->m_hardLimitBytes && p_memPool->GetReservedBytes() + extraBytes > p_budget->m_hardLimitBytes)
+			return false;
+		if (m_GlobalBudget.m_hardLimitBytes && GetReservedBytes() + extraBytes > m_GlobalBudget.m_hardLimitBytes)
+			return false;
+		return true;
+	}
+
+	bool MemoryPoolManager::EnforceHardLimits(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo, size_t extraBytes)
+	{
+		if (FitsHardLimits(p_memPool, allocSize, p_typeInfo, extraBytes))
+			return true;
+
+		//Over a hard limit. Give back everything we can before failing the allocation.
+		if (m_IsGarbageCollectionOn)
+			CollectAbandonedMemory();
+		TrimEmptyBlocks();
+
+		//The collection may have freed a chunk in this very pool, then it doesn't need to grow at all
+		if (extraBytes != 0 && p_memPool->HasFreeChunk())
+			return true;
+		return FitsHardLimits(p_memPool, allocSize, p_typeInfo, extraBytes);
+	}
+
+	void MemoryPoolManager::CheckSoftLimits(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo)
+	{
+		//Work out which budgets just went over their soft limit. A budget is signaled once per crossing.
+		MemoryPressureEvent events[2];
+		int eventCount = 0;
+
+		MemoryBudget* p_budget = FindBudget(allocSize, p_typeInfo);
+		if (p_budget && p_budget->m_softLimitBytes)
+		{
+			size_t reservedBytes = p_memPool->GetReservedBytes();
+			if (reservedBytes < p_budget->m_softLimitBytes)
+			{
+				p_budget->m_isSoftLimitSignaled = false;
+			}
+			else if (!p_budget->m_isSoftLimitSignaled)
+			{
+				p_budget->m_isSoftLimitSignaled = true;
+				MemoryPressureEvent& pressureEvent = events[eventCount++];
+				pressureEvent.m_isGlobal = false;
+				pressureEvent.m_allocSize = allocSize;
+				pressureEvent.m_pTypeInfo = p_typeInfo;
+				pressureEvent.m_reservedBytes = reservedBytes;
+				pressureEvent.m_softLimitBytes = p_budget->m_softLimitBytes;
+				pressureEvent.m_hardLimitBytes = p_budget->m_hardLimitBytes;
+			}
+		}
+
+		if (m_GlobalBudget.m_softLimitBytes)
+		{
+			size_t reservedBytes = GetReservedBytes();
+			if (reservedBytes < m_GlobalBudget.m_softLimitBytes)
+			{
+				m_GlobalBudget.m_isSoftLimitSignaled = false;
+			}
+			else if (!m_GlobalBudget.m_isSoftLimitSignaled)
+			{
+				m_GlobalBudget.m_isSoftLimitSignaled = true;
+				MemoryPressureEvent& pressureEvent = events[eventCount++];
+				pressureEvent.m_isGlobal = true;
+				pressureEvent.m_allocSize = 0;
+				pressureEvent.m_pTypeInfo = nullptr;
+				pressureEvent.m_reservedBytes = reservedBytes;
+				pressureEvent.m_softLimitBytes = m_GlobalBudget.m_softLimitBytes;
+				pressureEvent.m_hardLimitBytes = m_GlobalBudget.m_hardLimitBytes;
+			}
+		}
+
+		if (eventCount == 0)
+			return;
+
+		//Let the subsystems drop what they can, then hand the emptied blocks back
+		for (int i = 0; i < eventCount; i++)
+		{
+			for (size_t c = 0; c < m_PressureCallbacks.size(); c++)
+				m_PressureCallbacks[c](*this, events[i]);
+		}
+		TrimEmptyBlocks();
 		return;
 	}
 
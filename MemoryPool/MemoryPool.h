@@ -2,11 +2,33 @@
  
 
 #include<map> 
+#include <vector>
 #include <iostream>
 #include <exception>
 #include <memory>
+#include <functional>
+#include <typeinfo>
+#include <typeindex>
+#include <new>
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <malloc.h>
+#endif
 using namespace std;
 
+	/*
+		(1)
+		How a MemoryPool keeps track of its free chunks. CHUNK_TRACKING_FREE_LIST is the original linked list described below.
+		CHUNK_TRACKING_BITMAP drops the per chunk header and gives every block an occupancy bitmap instead, so allocations come
+		from the lowest free chunk of the fullest block. Chunks allocated together end up next to each other in memory and
+		lightly used blocks drain completely so that they can be released with TrimEmptyBlocks().
+	*/
+	enum ChunkTracking
+	{
+		CHUNK_TRACKING_FREE_LIST,
+		CHUNK_TRACKING_BITMAP
+	};
+
 	/*
 		(1)
 		This class creates a memory pool using a linked list which is defined using memory locations. Each memory location is defined as a chunk.
@@ -30,9 +52,21 @@ using namespace std;
 		unsigned int m_memArraySize, m_memArrayMaxSize;		// The number elements in the memory array, and the max allowed
 		bool m_toAllowResize;				// True if we resize the memory pool when it fills
 		bool m_isMemPoolReady;
+		ChunkTracking m_chunkTracking;		// Free list or per block occupancy bitmap
+		unsigned int m_bitmapWords;			// (Bitmap tracking) The number of bitmap words per block
+		size_t m_blockHeaderSize;			// (Bitmap tracking) The bytes in front of the first chunk of each block
+		size_t m_chunkAlignment;			// (Bitmap tracking) Alignment of each block's first chunk, 0 for plain malloc
 		const static size_t CHUNK_HEADER_SIZE = (sizeof(unsigned char*));
 		const static int MEMORY_ARRAY_SIZE = 1;
 		const static int MAX_MEMORY_ARRAY_SIZE = 20;
+		const static unsigned int BITMAP_WORD_BITS = 32;
+
+		//(Bitmap tracking) This sits at the front of every block and is followed by the occupancy bitmap, one bit per chunk (1 = free).
+		struct BitmapBlockHeader
+		{
+			unsigned int m_usedChunks;		// The number of chunks handed out from this block
+			unsigned int m_firstFreeWord;	// No bitmap word before this one has a free bit
+		};
 
 	public:
 		//Construction
@@ -44,6 +78,10 @@ using namespace std;
 			m_pHead = nullptr;
 			m_isMemPoolReady = false;
 			m_toAllowResize = true;
+			m_chunkTracking = CHUNK_TRACKING_FREE_LIST;
+			m_bitmapWords = 0;
+			m_blockHeaderSize = 0;
+			m_chunkAlignment = 0;
 			return;
 		}
 		MemoryPool(bool resize)
@@ -54,6 +92,10 @@ using namespace std;
 			m_pHead = nullptr;
 			m_isMemPoolReady = false;
 			m_toAllowResize = resize;
+			m_chunkTracking = CHUNK_TRACKING_FREE_LIST;
+			m_bitmapWords = 0;
+			m_blockHeaderSize = 0;
+			m_chunkAlignment = 0;
 			return;
 		} 
 		~MemoryPool(void)
@@ -72,11 +114,57 @@ using namespace std;
 		void* Alloc(void); //This returns a chunk, not a block
 		void Free(void* pMem);// This frees a chunk, not a block
 		unsigned int GetChunkSize(void) const { return m_chunkSize; }
+		unsigned int TrimEmptyBlocks(void);// Releases blocks with no chunks in use, always keeping one. Returns the number released.
+		bool HasFreeChunk(void);// False when the next Alloc would have to grow the pool
+
+		//(Bitmap tracking) Spans of neighboring chunks. A span is freed with FreeSpan, not Free.
+		bool TryExtendInPlace(void* pMem, unsigned int spanChunks, unsigned int newSpanChunks);//Claims the free chunks right after the span, if there are enough in the same block
+		void FreeSpan(void* pMem, unsigned int spanChunks);
+		size_t GetBlockBytes(void) const { return m_blockHeaderSize + GetChunkStride() * m_numChunks; }// What one more block costs
+		size_t GetReservedBytes(void) const { return m_ppRawMemoryArray ? GetBlockBytes() * m_memArraySize : 0; }
+
+		//(Bitmap tracking) Calls fn(void* pChunk) for every chunk in use, block by block and in address order within a block.
+		//Free chunks are skipped a whole bitmap word at a time.
+		template<class Fn>
+		void ForEachAllocatedChunk(Fn fn)
+		{
+			if (m_chunkTracking != CHUNK_TRACKING_BITMAP || !m_ppRawMemoryArray)
+				return;
+
+			for (unsigned int i = 0; i < m_memArraySize; i++)
+			{
+				unsigned char* pBlock = m_ppRawMemoryArray[i];
+				unsigned int usedLeft = GetBlockHeader(pBlock)->m_usedChunks;
+				unsigned int* pBitmap = GetBlockBitmap(pBlock);
+				unsigned char* pChunks = GetBlockChunks(pBlock);
+				for (unsigned int w = 0; w < m_bitmapWords && usedLeft > 0; w++)
+				{
+					//A clear bit is a chunk in use. Mask off the padding bits of the last word.
+					unsigned int live = ~pBitmap[w];
+					unsigned int bitsInWord = m_numChunks - w * BITMAP_WORD_BITS;
+					if (bitsInWord < BITMAP_WORD_BITS)
+						live &= (1u << bitsInWord) - 1;
+
+					while (live)
+					{
+						unsigned int bit = LowestSetBit(live);
+						live &= live - 1;
+						usedLeft--;
+						fn((void*)(pChunks + (size_t)(w * BITMAP_WORD_BITS + bit) * m_chunkSize));
+					}
+				}
+			}
+			return;
+		}
 
 		//Settings
 		bool GetReadyStatus() { return m_isMemPoolReady; }
 		bool GetAllowResize() { return m_toAllowResize; }
 		void SetAllowResize(bool resize) { m_toAllowResize = resize; return; }
+		ChunkTracking GetChunkTracking() { return m_chunkTracking; }
+		bool SetChunkTracking(ChunkTracking tracking);//Must be called before Init
+		bool SetChunkAlignment(size_t alignment);//(Bitmap tracking) Power of 2, must be called before Init. Every chunk is aligned when chunkSize is a multiple of it.
+		size_t GetBlockHeaderSize() { return m_blockHeaderSize; }
 
 	private:
 		//Resets internal vars
@@ -85,12 +173,33 @@ using namespace std;
 		//Internal memory allocation helpers
 		bool GrowMemoryArray(int initialMemoryArraySize = 0);//When this runs the allocated memory to the program is actually increased twice as much + 1. And I guess this prevents having to call this too many times.
 		unsigned char* AllocateNewMemoryBlock(void);
+		unsigned char* AllocateBlockMemory(size_t size);
+		void FreeBlockMemory(unsigned char* pBlock);
 		void Destroy(void);
 
 		//Internal linked list management
 		unsigned char* GetNext(unsigned char* pBlock);
 		void SetNext(unsigned char* pBlockToChange, unsigned char* pNewNext);
 
+		//Internal bitmap management
+		void* AllocFromBitmap(void);
+		void FreeToBitmap(void* pMem);
+		int FindOwningBlock(void* pMem);
+		size_t GetChunkStride(void) const { return (m_chunkTracking == CHUNK_TRACKING_BITMAP) ? m_chunkSize : m_chunkSize + CHUNK_HEADER_SIZE; }
+		BitmapBlockHeader* GetBlockHeader(unsigned char* pBlock) { return (BitmapBlockHeader*)pBlock; }
+		unsigned int* GetBlockBitmap(unsigned char* pBlock) { return (unsigned int*)(pBlock + sizeof(BitmapBlockHeader)); }
+		unsigned char* GetBlockChunks(unsigned char* pBlock) { return pBlock + m_blockHeaderSize; }
+		static unsigned int LowestSetBit(unsigned int word)//word must not be 0
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, word);
+			return (unsigned int)index;
+#else
+			return (unsigned int)__builtin_ctz(word);
+#endif
+		}
+
 		//Don't allow copy constructor
 		MemoryPool(const MemoryPool& memPool) {}
 	};
@@ -138,11 +247,14 @@ using namespace std;
 	{
 	public:
 		MemPoolMangrContext() {}
-		MemPoolMangrContext(size_t size, void* memory, size_t hash_code = 0)
+		MemPoolMangrContext(size_t size, void* memory, const type_info* p_typeInfo = nullptr)
 		{
 			m_MemoryChunkSize = size;
 			p_MemoryAddress = memory;
-			m_typeinfo_hash_code = hash_code;
+			m_IsTyped = (p_typeInfo != nullptr);
+			p_TypeInfo = p_typeInfo;
+			m_typeinfo_hash_code = m_IsTyped ? p_typeInfo->hash_code() : 0;
+			m_SpanChunks = 1;
 			return;
 		} 
 		~MemPoolMangrContext() override
@@ -152,7 +264,10 @@ using namespace std;
 		}
 		size_t m_MemoryChunkSize;
 		void* p_MemoryAddress;
-		size_t m_typeinfo_hash_code;//NOTE:(Optional) This may come in handy later for querying a list of these context objects for a specific type.
+		unsigned int m_SpanChunks;//Chunks of m_MemoryChunkSize this allocation covers, more than 1 once ReallocateChunk grew it in place
+		bool m_IsTyped;//Set by MemoryPoolManager::Allocate<T>(). The chunk then lives in the typed pool of *p_TypeInfo.
+		const type_info* p_TypeInfo;//nullptr for untyped chunks
+		size_t m_typeinfo_hash_code;//NOTE: Informational only, hash codes are not unique. 0 for untyped chunks. This may come in handy later for querying a list of these context objects for a specific type.
 		//For example: using a SetVector<MemPoolMangrContext> setv;  then use the select feature to filter according to this hash code.
 		//Once you know the type of the object, you could reconstruct the memory values for the that object by casting p_MemoryAddress to a pointer of the type.
 		//Now that I pray on it, I could use this for an awsome recovery system. What if I needed to change the state of all objects of type A in memory in response to 
@@ -164,6 +279,23 @@ using namespace std;
 	};
 
 
+	/*
+		(1)
+		Passed to the memory pressure callbacks of a MemoryPoolManager when an allocation takes a pool, or all pools together,
+		past a soft limit.
+	*/
+	class MemoryPoolManager;
+	struct MemoryPressureEvent
+	{
+		bool m_isGlobal;				// True for the global budget, false for a single pool's budget
+		size_t m_allocSize;				// Chunk size of the pool (0 for the global budget)
+		const type_info* m_pTypeInfo;	// Type of a typed pool, nullptr otherwise
+		size_t m_reservedBytes;			// Bytes reserved by the pool (or all pools) right now
+		size_t m_softLimitBytes;
+		size_t m_hardLimitBytes;
+	};
+	typedef function<void(MemoryPoolManager& manager, const MemoryPressureEvent& pressureEvent)> MemoryPressureCallback;
+
 	/*
 		This class is a memory pool manager. It is un-managed by default, meaning you must call the deallocation method before
 		you assign your pointer to something else or it will cause a memory leak in the Memory Pool. However, it can be extended
@@ -200,6 +332,10 @@ using namespace std;
 			 m_ValidationMapIter = m_ValidationMap.end();
 			 m_MainMapIter = m_MainMap.end();
 			 m_IsGarbageCollectionOn = false;
+			 m_ChunkTracking = CHUNK_TRACKING_FREE_LIST;
+			 m_GlobalBudget.m_softLimitBytes = 0;
+			 m_GlobalBudget.m_hardLimitBytes = 0;
+			 m_GlobalBudget.m_isSoftLimitSignaled = false;
 			return;
 		}
 		~MemoryPoolManager() override
@@ -216,23 +352,106 @@ using namespace std;
 		//Management
 		bool AllocateChunk(void*& ptr, size_t allocSize);
 		bool DeallocateChunk(void*& ptr);
+		//Resizes an untyped chunk. The same chunk comes back when newSize still fits. A chunk in a bitmap tracked pool grows
+		//in place when the chunks right after it are free. Only otherwise is the data copied, to a chunk of the next
+		//power of two size so later growth up to that size needs no copy.
+		//On failure ptr and its memory are left untouched.
+		bool ReallocateChunk(void*& ptr, size_t newSize);
+
+		//Typed management. Every type gets its own bitmap tracked pool (keyed by type_index(typeid(T))) so all live objects
+		//of one type sit together and can be walked with ForEach<T>(). Chunks are aligned to alignof(T). Allocate default
+		//constructs the object and Deallocate destroys it. Objects freed by garbage collection or still alive when the manager goes away are not destroyed.
+		template<class T>
+		bool Allocate(T*& ptr)
+		{
+			void*& rawPtr = reinterpret_cast<void*&>(ptr);
+			if (!AllocateChunk(rawPtr, sizeof(T), &typeid(T), alignof(T)))
+				return false;
+			::new (rawPtr) T();//Scope resolution so MemoryPoolManagedClass's operator new doesn't hide placement new
+			return true;
+		}
+		template<class T>
+		bool Deallocate(T*& ptr)
+		{
+			void*& rawPtr = reinterpret_cast<void*&>(ptr);
+			ValidationMappingTypeIter iter = m_ValidationMap.find(&rawPtr);
+			if (iter == m_ValidationMap.end() || iter->second.p_MemoryAddress != rawPtr || !iter->second.m_IsTyped || *iter->second.p_TypeInfo != typeid(T))
+				return false;
+			ptr->~T();
+			return DeallocateChunk(rawPtr);
+		}
+		//Calls fn(T&) for every live T in memory order. Walks the pool's occupancy bitmaps, not the validation map.
+		template<class T, class Fn>
+		void ForEach(Fn fn)
+		{
+			TypedMappingTypeIter iter = m_TypedMap.find(type_index(typeid(T)));
+			if (iter == m_TypedMap.end())
+				return;
+			iter->second.ForEachAllocatedChunk([&fn](void* pChunk) { fn(*(T*)pChunk); });
+			return;
+		}
 		bool m_IsGarbageCollectionOn;		
+		ChunkTracking m_ChunkTracking;//Tracking used by memory pools created from now on
+
+		//Budgets, in bytes reserved by the pools' blocks. 0 means no limit. When an allocation takes a pool or the whole
+		//manager past a soft limit, the pressure callbacks run once (until it drops back under) so subsystems can drop caches,
+		//then empty blocks are trimmed. Before a pool grows past a hard limit, the manager runs garbage collection (if it is on)
+		//and trims empty blocks in every pool, and only then fails the allocation.
+		void SetGlobalBudget(size_t softLimitBytes, size_t hardLimitBytes);
+		void SetPoolBudget(size_t allocSize, size_t softLimitBytes, size_t hardLimitBytes);
+		template<class T>
+		void SetTypeBudget(size_t softLimitBytes, size_t hardLimitBytes)
+		{
+			SetBudget(m_TypeBudgets[type_index(typeid(T))], softLimitBytes, hardLimitBytes);
+			return;
+		}
+		void AddPressureCallback(MemoryPressureCallback callback) { m_PressureCallbacks.push_back(callback); return; }
+		size_t GetReservedBytes(void);
+		unsigned int TrimEmptyBlocks(void);//Trims every pool, returns the number of blocks released
 
 	private:  
 		typedef map<size_t, MemoryPool> MainMappingType;
 		typedef map<size_t, MemoryPool>::iterator MainMappingTypeIter;
+		typedef map<type_index, MemoryPool> TypedMappingType;
+		typedef map<type_index, MemoryPool>::iterator TypedMappingTypeIter;
 		typedef map<void**, MemPoolMangrContext> ValidationMappingType;
 		typedef map<void**, MemPoolMangrContext>::iterator ValidationMappingTypeIter;
 		MainMappingType m_MainMap;
 		MainMappingTypeIter m_MainMapIter;
+		TypedMappingType m_TypedMap;//Typed pools, keyed by type instead of chunk size
 		map<void**, MemPoolMangrContext>  m_ValidationMap;
 		ValidationMappingTypeIter  m_ValidationMapIter;
 
+		struct MemoryBudget
+		{
+			size_t m_softLimitBytes;
+			size_t m_hardLimitBytes;
+			bool m_isSoftLimitSignaled;	// The callbacks already ran for this crossing
+		};
+		typedef map<size_t, MemoryBudget> BudgetMappingType;
+		typedef map<type_index, MemoryBudget> TypeBudgetMappingType;
+		MemoryBudget m_GlobalBudget;
+		BudgetMappingType m_PoolBudgets;//Keyed by chunk size
+		TypeBudgetMappingType m_TypeBudgets;//Keyed by type
+		vector<MemoryPressureCallback> m_PressureCallbacks;
+
 		//The number of chuncks in each allocated block. The MemoryPool class is defaulted to 1 block initially, then it will extend if needed.
 		const unsigned int BLOCK_SIZE_TIER1 = 1;
 		const unsigned int BLOCK_SIZE_TIER2 = 50;
 		const unsigned int BLOCK_SIZE_TIER3 = 100;
+		const unsigned int BLOCK_SIZE_TYPED = 8192;//Typed pools hold whole component arrays, so their blocks are much bigger
+
+		bool AllocateChunk(void*& ptr, size_t allocSize, const type_info* p_typeInfo, size_t alignment);
+		MemoryPool* GetOrCreatePool(size_t allocSize, const type_info* p_typeInfo, size_t alignment);
+		MemoryPool* FindPool(const MemPoolMangrContext& context);
+		void* AllocateFromPool(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo);
 
+		//Budget enforcement
+		static void SetBudget(MemoryBudget& budget, size_t softLimitBytes, size_t hardLimitBytes);
+		MemoryBudget* FindBudget(size_t allocSize, const type_info* p_typeInfo);
+		bool FitsHardLimits(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo, size_t extraBytes);
+		bool EnforceHardLimits(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo, size_t extraBytes);
+		void CheckSoftLimits(MemoryPool* p_memPool, size_t allocSize, const type_info* p_typeInfo);
 
 		void CollectAbandonedMemory(void);
 		void FreeAbandonedMemory(MemPoolMangrContext& context);
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "SharedMemoryPool.h"
+#include <new>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+	SharedMemoryPool::SharedMemoryPool(void)
+	{
+		m_pRegion = nullptr;
+		m_regionSize = 0;
+		m_isOwner = false;
+		m_isMemPoolReady = false;
+#ifdef _WIN32
+		m_hMapping = NULL;
+#else
+		m_fd = -1;
+#endif
+		return;
+	}
+
+	bool SharedMemoryPool::Create(const char* name, unsigned int chunkSize, unsigned int numChunks)
+	{
+		try
+		{
+			if (m_pRegion || !name || chunkSize == 0 || numChunks == 0)
+				return false;
+
+			//Offsets are 32 bit, so the whole region has to stay under 4GB
+			size_t chunkStride = (CHUNK_HEADER_SIZE + chunkSize + CHUNK_HEADER_SIZE - 1) & ~(CHUNK_HEADER_SIZE - 1);
+			size_t regionSize = GetFirstChunkOffset() + chunkStride * numChunks;
+			if (regionSize > 0xFFFFFFFFull)
+				return false;
+
+			m_name = name;
+			m_isOwner = true;
+			if (!MapRegion(regionSize, true))
+			{
+				Close();
+				return false;
+			}
+
+			//The atomics have to be lock free, a lock based atomic only locks inside this process
+			SharedRegionHeader* pHeader = new (m_pRegion) SharedRegionHeader;
+			if (!pHeader->m_head.is_lock_free() || !pHeader->m_readyFlag.is_lock_free())
+			{
+				Close();
+				return false;
+			}
+			pHeader->m_chunkSize = chunkSize;
+			pHeader->m_numChunks = numChunks;
+			pHeader->m_chunkStride = (unsigned int)chunkStride;
+
+			//Turn the region into a linked list of chunks, using offsets
+			SharedOffset first = (SharedOffset)GetFirstChunkOffset();
+			for (unsigned int i = 0; i < numChunks; i++)
+			{
+				SharedOffset curr = first + i * (SharedOffset)chunkStride;
+				new (m_pRegion + curr) atomic<SharedOffset>((i + 1 < numChunks) ? curr + (SharedOffset)chunkStride : 0);
+			}
+			pHeader->m_head.store(first, memory_order_relaxed);
+
+			//Publish the pool to the other processes last
+			pHeader->m_readyFlag.store(REGION_READY_FLAG, memory_order_release);
+			m_isMemPoolReady = true;
+			return true;
+		}
+		catch (exception& ex)
+		{
+			cout << ex.what() << endl;
+		}
+		return false;
+	}
+
+	bool SharedMemoryPool::Open(const char* name)
+	{
+		try
+		{
+			if (m_pRegion || !name)
+				return false;
+
+			m_name = name;
+			m_isOwner = false;
+			if (!MapRegion(0, false) || m_regionSize < GetFirstChunkOffset())
+			{
+				Close();
+				return false;
+			}
+
+			if (GetRegionHeader()->m_readyFlag.load(memory_order_acquire) != REGION_READY_FLAG)
+			{
+				Close();
+				return false;
+			}
+			m_isMemPoolReady = true;
+			return true;
+		}
+		catch (exception& ex)
+		{
+			cout << ex.what() << endl;
+		}
+		return false;
+	}
+
+	bool SharedMemoryPool::MapRegion(size_t size, bool create)
+	{
+#ifdef _WIN32
+		if (create)
+		{
+			m_hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, m_name.c_str());
+			if (m_hMapping && GetLastError() == ERROR_ALREADY_EXISTS)
+				return false;//Somebody else owns this name
+		}
+		else
+		{
+			m_hMapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, m_name.c_str());
+		}
+		if (!m_hMapping)
+			return false;
+
+		m_pRegion = (unsigned char*)MapViewOfFile(m_hMapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		if (!m_pRegion)
+			return false;
+
+		//Mapping with size 0 maps the whole section, ask how big that was
+		MEMORY_BASIC_INFORMATION info;
+		if (!VirtualQuery(m_pRegion, &info, sizeof(info)))
+			return false;
+		m_regionSize = create ? size : info.RegionSize;
+		return true;
+#else
+		m_fd = create ? shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : shm_open(m_name.c_str(), O_RDWR, 0);
+		if (m_fd < 0)
+		{
+			m_isOwner = false;//Don't unlink a name we didn't create
+			return false;
+		}
+		if (create)
+		{
+			if (ftruncate(m_fd, (off_t)size) != 0)
+				return false;
+		}
+		else
+		{
+			struct stat info;
+			if (fstat(m_fd, &info) != 0)
+				return false;
+			size = (size_t)info.st_size;
+		}
+		if (size == 0)
+			return false;
+
+		void* pRegion = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (pRegion == MAP_FAILED)
+			return false;
+		m_pRegion = (unsigned char*)pRegion;
+		m_regionSize = size;
+		return true;
+#endif
+	}
+
+	void SharedMemoryPool::Close(void)
+	{
+#ifdef _WIN32
+		if (m_pRegion)
+			UnmapViewOfFile(m_pRegion);
+		if (m_hMapping)
+			CloseHandle(m_hMapping);//The section goes away with the last handle, there is no name to remove
+		m_hMapping = NULL;
+#else
+		if (m_pRegion)
+			munmap(m_pRegion, m_regionSize);
+		if (m_fd >= 0)
+			close(m_fd);
+		if (m_isOwner && !m_name.empty())
+			shm_unlink(m_name.c_str());//Processes that still have it mapped keep working
+		m_fd = -1;
+#endif
+		m_pRegion = nullptr;
+		m_regionSize = 0;
+		m_isOwner = false;
+		m_isMemPoolReady = false;
+		return;
+	}
+
+	void* SharedMemoryPool::Alloc(void)
+	{
+		if (!m_isMemPoolReady)
+			return nullptr;
+
+		//Pop the head. If another thread or process changed it first, the compare and swap reloads oldHead and we try again.
+		SharedRegionHeader* pHeader = GetRegionHeader();
+		unsigned long long oldHead = pHeader->m_head.load(memory_order_acquire);
+		for (;;)
+		{
+			SharedOffset chunkOffset = (SharedOffset)oldHead;
+			if (chunkOffset == 0)
+				return nullptr;//No more free chunks, a shared pool never grows
+
+			unsigned long long newHead = (((oldHead >> 32) + 1) << 32) | GetNext(chunkOffset);
+			if (pHeader->m_head.compare_exchange_weak(oldHead, newHead, memory_order_acq_rel, memory_order_acquire))
+				return m_pRegion + chunkOffset + CHUNK_HEADER_SIZE;//Seek up to the data section
+		}
+	}
+
+	void SharedMemoryPool::Free(void* pMem)
+	{
+		//Calling Free() on a NULL pointer is perfectly valid C++ so we have to check for it.
+		if (!pMem || !m_isMemPoolReady)
+			return;
+
+		SharedOffset chunkOffset = GetOffset(pMem);
+		if (chunkOffset == 0)
+			return;//Not one of ours
+		chunkOffset -= (SharedOffset)CHUNK_HEADER_SIZE;
+
+		//Push the chunk to the front of the list
+		SharedRegionHeader* pHeader = GetRegionHeader();
+		unsigned long long oldHead = pHeader->m_head.load(memory_order_relaxed);
+		for (;;)
+		{
+			SetNext(chunkOffset, (SharedOffset)oldHead);
+			unsigned long long newHead = (((oldHead >> 32) + 1) << 32) | chunkOffset;
+			if (pHeader->m_head.compare_exchange_weak(oldHead, newHead, memory_order_release, memory_order_relaxed))
+				return;
+		}
+	}
+
+	SharedMemoryPool::SharedOffset SharedMemoryPool::GetOffset(void* pMem) const
+	{
+		if (!m_pRegion || !pMem)
+			return 0;
+
+		unsigned char* p = (unsigned char*)pMem;
+		if (p < m_pRegion + CHUNK_HEADER_SIZE || p >= m_pRegion + m_regionSize)
+			return 0;
+
+		SharedOffset dataOffset = (SharedOffset)(p - m_pRegion);
+		return IsChunkOffset(dataOffset - (SharedOffset)CHUNK_HEADER_SIZE) ? dataOffset : 0;
+	}
+
+	void* SharedMemoryPool::GetPointer(SharedOffset offset) const
+	{
+		if (!m_pRegion || offset < CHUNK_HEADER_SIZE || !IsChunkOffset(offset - (SharedOffset)CHUNK_HEADER_SIZE))
+			return nullptr;
+		return m_pRegion + offset;
+	}
+
+	bool SharedMemoryPool::IsChunkOffset(SharedOffset chunkOffset) const
+	{
+		SharedRegionHeader* pHeader = GetRegionHeader();
+		size_t first = GetFirstChunkOffset();
+		if (chunkOffset < first)
+			return false;
+		size_t index = (chunkOffset - first) / pHeader->m_chunkStride;
+		return index < pHeader->m_numChunks && (chunkOffset - first) % pHeader->m_chunkStride == 0;
+	}
+
+	SharedMemoryPool::SharedOffset SharedMemoryPool::GetNext(SharedOffset chunkOffset)
+	{
+		//Another process may be pushing this chunk right now. The value is only trusted if the compare and swap succeeds.
+		return ((atomic<SharedOffset>*)(m_pRegion + chunkOffset))->load(memory_order_relaxed);
+	}
+
+	void SharedMemoryPool::SetNext(SharedOffset chunkOffset, SharedOffset nextOffset)
+	{
+		((atomic<SharedOffset>*)(m_pRegion + chunkOffset))->store(nextOffset, memory_order_relaxed);
+		return;
+	}
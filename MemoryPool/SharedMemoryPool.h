@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <iostream>
+#include <exception>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+using namespace std;
+
+	/*
+		(1)
+		This class is a fixed size memory pool whose chunks live in a named shared memory region, so that several processes
+		can map the same pool. One process calls Create(name, chunkSize, numChunks), the others call Open(name). A chunk
+		allocated in one process can be freed by any other process that has the pool open.
+
+		(2)
+		Every process maps the region at a different address, so the raw unsigned char* links used by MemoryPool's SetNext/GetNext
+		can't be shared. Here each chunk header holds the offset of the next free chunk from the start of the region instead,
+		and offset 0 (which is the region header) means "end of list". The head of the free list lives in the region header and
+		is popped/pushed with a compare and swap. The upper 32 bits of the head are a tag that is bumped on every change so a
+		chunk that was popped and pushed back in between can't fool the compare and swap (ABA).
+
+		(3)
+		Pointers can't be sent to another process either. Use GetOffset(pMem) to turn a chunk into something that can be
+		put in a message and GetPointer(offset) on the other side to turn it back into a pointer.
+
+		Names follow the platform: "Local\\SimMessages" on Windows (file mapping backed by the page file), "/SimMessages"
+		for shm_open everywhere else. The region is fixed size, a shared pool never grows.
+	*/
+	class SharedMemoryPool
+	{
+	public:
+		typedef unsigned int SharedOffset;
+
+	private:
+		struct SharedRegionHeader
+		{
+			atomic<unsigned int> m_readyFlag;	// REGION_READY_FLAG once the creator has built the free list
+			unsigned int m_chunkSize;
+			unsigned int m_numChunks;
+			unsigned int m_chunkStride;			// Chunk header + chunk size
+			atomic<unsigned long long> m_head;	// High 32 bits: ABA tag, low 32 bits: offset of the first free chunk
+		};
+
+		unsigned char* m_pRegion;				// Where the region is mapped in this process
+		size_t m_regionSize;
+		bool m_isOwner;							// True in the process that called Create, it removes the region name on Close
+		bool m_isMemPoolReady;
+		string m_name;
+#ifdef _WIN32
+		HANDLE m_hMapping;
+#else
+		int m_fd;
+#endif
+		const static size_t CHUNK_HEADER_SIZE = 8;	// Holds a 4 byte next offset, padded to keep the data section 8 byte aligned
+		const static unsigned int REGION_READY_FLAG = 0x4D504F4C;
+
+	public:
+		//Construction
+		SharedMemoryPool(void);
+		~SharedMemoryPool(void)
+		{
+			Close();
+			return;
+		}
+		bool Create(const char* name, unsigned int chunkSize, unsigned int numChunks);
+		bool Open(const char* name);//Returns false if the creator hasn't finished building the pool yet, try again later.
+		void Close(void);
+
+		//Allocation functions. Both are lock free and safe to call from any thread of any process that has the pool open.
+		void* Alloc(void);
+		void Free(void* pMem);
+		unsigned int GetChunkSize(void) const { return m_pRegion ? GetRegionHeader()->m_chunkSize : 0; }
+
+		//Passing chunks between processes
+		SharedOffset GetOffset(void* pMem) const;//Returns 0 for memory that isn't a chunk of this pool
+		void* GetPointer(SharedOffset offset) const;
+
+		//Settings
+		bool GetReadyStatus() { return m_isMemPoolReady; }
+		bool GetIsOwner() { return m_isOwner; }
+
+	private:
+		SharedRegionHeader* GetRegionHeader(void) const { return (SharedRegionHeader*)m_pRegion; }
+		static size_t GetFirstChunkOffset(void) { return (sizeof(SharedRegionHeader) + CHUNK_HEADER_SIZE - 1) & ~(CHUNK_HEADER_SIZE - 1); }
+		bool MapRegion(size_t size, bool create);
+		bool IsChunkOffset(SharedOffset chunkOffset) const;
+
+		//Internal linked list management, using offsets instead of pointers
+		SharedOffset GetNext(SharedOffset chunkOffset);
+		void SetNext(SharedOffset chunkOffset, SharedOffset nextOffset);
+
+		//Don't allow copy constructor
+		SharedMemoryPool(const SharedMemoryPool& memPool) {}
+	};